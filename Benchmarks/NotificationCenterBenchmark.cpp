@@ -0,0 +1,153 @@
+/****************************************************************************
+  Copyright (c) 2013-2014 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+// Standalone benchmark of posting to many observers of one notification,
+// against a std::list of callbacks as the observers used to be stored.
+// Not part of any project, build it by hand with the sources.
+// WorkQueue.h and WorkQueue.cpp are UTF-16, convert them to UTF-8 for g++
+// first (iconv -f UTF-16 -t UTF-8), then e.g.
+//   g++ -std=c++11 -O2 -pthread -I../Classes NotificationCenterBenchmark.cpp
+//       ../Classes/Notification*.cpp ../Classes/Foundation/Epoch.cpp
+//       ../Classes/Foundation/WorkQueue.cpp ../Classes/Foundation/Task.cpp
+//       ../Classes/Foundation/Strand.cpp ../Classes/Foundation/CpuTopology.cpp
+//       ../Classes/Foundation/Histogram.cpp
+// Usage: NotificationCenterBenchmark [observer count]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <list>
+#include <random>
+#include <vector>
+#include "NotificationCenter.h"
+
+using namespace Foundation;
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+const int REPEATS = 5;
+
+/**
+ * Best time of REPEATS runs in nanoseconds per item.
+ */
+double measure(size_t items, const std::function<void()>& run)
+{
+    double best = 0;
+    for (int i = 0; i < REPEATS; ++i)
+    {
+        clock_type::time_point start = clock_type::now();
+        run();
+        double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / items;
+        if (i == 0 || ns < best)
+        {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+void report(const char* name, double ns)
+{
+    std::printf("%-28s %8.2f ns\n", name, ns);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    size_t count = argc > 1 ? static_cast<size_t>(std::strtoull(argv[1], nullptr, 10)) : 10000;
+    const int POSTS = 200;
+    std::printf("%zu observers, %d posts per run\n", count, POSTS);
+
+    volatile uint64_t calls = 0;
+    std::function<void()> callback = [&calls]{ calls = calls + 1; };
+
+    // Nodes allocated back to back would be walked in address order; after
+    // observers came and went they are not, shuffle the node order.
+    std::list<std::function<void()> > allocated(count, callback);
+    std::vector<std::list<std::function<void()> >::iterator> nodes;
+    for (auto i = allocated.begin(); i != allocated.end(); ++i)
+    {
+        nodes.push_back(i);
+    }
+    std::shuffle(nodes.begin(), nodes.end(), std::mt19937(42));
+    std::list<std::function<void()> > baseline;
+    for (auto& node : nodes)
+    {
+        baseline.splice(baseline.end(), allocated, node);
+    }
+    report("std::list post / observer", measure(count * POSTS, [&]
+    {
+        for (int n = 0; n < POSTS; ++n)
+        {
+            for (auto& f : baseline)
+            {
+                f();
+            }
+        }
+    }));
+
+    NotificationCenter center;
+    std::vector<ObserverHandle> handles(count);
+    NotificationId name("benchmark");
+    double add = measure(count, [&]
+    {
+        center.removeObservers(name);
+        for (size_t i = 0; i < count; ++i)
+        {
+            handles[i] = center.addObserver(callback, name);
+        }
+    });
+    report("addObserver", add);
+
+    report("post / observer", measure(count * POSTS, [&]
+    {
+        for (int n = 0; n < POSTS; ++n)
+        {
+            center.postNotification(name);
+        }
+    }));
+
+    // Every other observer removed, the list is not compacted yet.
+    for (size_t i = 0; i < count; i += 2)
+    {
+        center.removeObserver(name, handles[i]);
+    }
+    report("post / observer, half gone", measure(count / 2 * POSTS, [&]
+    {
+        for (int n = 0; n < POSTS; ++n)
+        {
+            center.postNotification(name);
+        }
+    }));
+
+    double remove = 0;
+    for (int i = 0; i < REPEATS; ++i)
+    {
+        center.removeObservers(name);
+        for (size_t j = 0; j < count; ++j)
+        {
+            handles[j] = center.addObserver(callback, name);
+        }
+        clock_type::time_point start = clock_type::now();
+        for (size_t j = 0; j < count; ++j)
+        {
+            center.removeObserver(name, handles[j]);
+        }
+        double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / count;
+        if (i == 0 || ns < remove)
+        {
+            remove = ns;
+        }
+    }
+    report("removeObserver", remove);
+    return 0;
+}
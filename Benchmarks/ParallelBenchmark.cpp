@@ -0,0 +1,164 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+// Standalone benchmark of Parallel.h against the serial standard algorithms,
+// on pools of 1 to hardware_concurrency() threads.
+// Not part of any project, build it by hand with the Foundation sources.
+// WorkQueue.h and WorkQueue.cpp are UTF-16, convert them to UTF-8 for g++
+// first (iconv -f UTF-16 -t UTF-8), then e.g.
+//   g++ -std=c++11 -O2 -pthread ParallelBenchmark.cpp
+//       ../Classes/Foundation/WorkQueue.cpp ../Classes/Foundation/Task.cpp
+//       ../Classes/Foundation/Strand.cpp ../Classes/Foundation/CpuTopology.cpp
+//       ../Classes/Foundation/Histogram.cpp
+// Usage: ParallelBenchmark [element count]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+#include "Parallel.h"
+
+using namespace Foundation;
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+const int REPEATS = 5;
+
+/**
+ * Best time of REPEATS runs in milliseconds, prepare runs before each
+ * run and is not timed.
+ */
+double measure(const std::function<void()>& prepare, const std::function<void()>& run)
+{
+    double best = 0;
+    for (int i = 0; i < REPEATS; ++i)
+    {
+        prepare();
+        clock_type::time_point start = clock_type::now();
+        run();
+        double ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+        if (i == 0 || ms < best)
+        {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+double speedup(double serial, double parallel)
+{
+    return parallel > 0 ? serial / parallel : 0.0;
+}
+
+// Enough work per element that the loop is not bound by memory bandwidth.
+inline double work(double x)
+{
+    return std::sqrt(x) * std::sin(x) + std::cos(x);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    size_t count = argc > 1 ? static_cast<size_t>(std::strtoull(argv[1], nullptr, 10)) : size_t(1) << 22;
+    size_t cores = std::thread::hardware_concurrency();
+    if (cores == 0)
+    {
+        cores = 1;
+    }
+    std::printf("%zu elements, pools of 1 to %zu threads\n", count, cores);
+
+    std::vector<double> input(count);
+    std::vector<double> output(count);
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> distribution(0.0, 1000.0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        input[i] = distribution(random);
+    }
+
+    std::function<void()> nothing = []{};
+    std::function<void()> shuffle = [&]
+    {
+        output = input;
+    };
+    volatile double sink = 0;
+
+    double serialFor = measure(nothing, [&]
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            output[i] = work(input[i]);
+        }
+    });
+    double serialReduce = measure(nothing, [&]
+    {
+        double sum = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            sum += work(input[i]);
+        }
+        sink = sum;
+    });
+    double serialTransform = measure(nothing, [&]
+    {
+        std::transform(input.begin(), input.end(), output.begin(), work);
+    });
+    double serialSort = measure(shuffle, [&]
+    {
+        std::stable_sort(output.begin(), output.end());
+    });
+    std::printf("serial ms        %9.2f %9.2f %9.2f %9.2f\n",
+                serialFor, serialReduce, serialTransform, serialSort);
+    std::printf("threads speedup  %9s %9s %9s %9s\n", "for", "reduce", "transform", "sort");
+
+    for (size_t n = 1; n <= cores; ++n)
+    {
+        WorkQueue queue(n, n);
+        double pooledFor = measure(nothing, [&]
+        {
+            parallelFor(size_t(0), count, [&](size_t i)
+            {
+                output[i] = work(input[i]);
+            }, 0, &queue);
+        });
+        double pooledReduce = measure(nothing, [&]
+        {
+            sink = parallelReduce(size_t(0), count, 0.0,
+                [&](size_t i) { return work(input[i]); },
+                [](double a, double b) { return a + b; }, 0, &queue);
+        });
+        double pooledTransform = measure(nothing, [&]
+        {
+            parallelTransform(input.begin(), input.end(), output.begin(), work, 0, &queue);
+        });
+        double pooledSort = measure(shuffle, [&]
+        {
+            parallelSort(output.begin(), output.end(), 0, &queue);
+        });
+        std::printf("%7zu          %8.2fx %8.2fx %8.2fx %8.2fx\n", n,
+                    speedup(serialFor, pooledFor),
+                    speedup(serialReduce, pooledReduce),
+                    speedup(serialTransform, pooledTransform),
+                    speedup(serialSort, pooledSort));
+
+        if (!std::is_sorted(output.begin(), output.end()))
+        {
+            std::printf("parallelSort left the range unsorted\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,292 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_Coroutine_h
+#define Foundation_Coroutine_h
+
+#include "FoundationMacros.h"
+
+#if FOUNDATION_HAS_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "Task.h"
+#include "WorkQueue.h"
+
+namespace Foundation {
+
+template<typename T = void>
+class CoTask;
+
+namespace detail {
+
+/**
+ * Coroutine frames are allocated from TaskPool, so a coroutine that is
+ * started and finished over and over on the same threads reuses its frame.
+ */
+struct PooledFrame
+{
+    static void* operator new(std::size_t size)
+    {
+        return TaskPool::allocate(size);
+    }
+
+    static void operator delete(void* p, std::size_t size)
+    {
+        TaskPool::deallocate(p, size);
+    }
+};
+
+class CoPromiseBase : public PooledFrame
+{
+public:
+    /**
+     * Resumes the awaiting coroutine by symmetric transfer, on the thread
+     * that finished the task and without growing its stack.
+     */
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            std::coroutine_handle<> continuation = handle.promise().m_continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return std::suspend_always(); }
+
+    FinalAwaiter final_suspend() const noexcept { return FinalAwaiter(); }
+
+    void unhandled_exception() noexcept { m_error = std::current_exception(); }
+
+    void setContinuation(std::coroutine_handle<> continuation) { m_continuation = continuation; }
+
+protected:
+    void rethrowIfFailed()
+    {
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    std::coroutine_handle<>   m_continuation;
+    std::exception_ptr        m_error;
+};
+
+template<typename T>
+class CoPromise : public CoPromiseBase
+{
+public:
+    CoTask<T> get_return_object();
+
+    template<typename U>
+    void return_value(U&& value)
+    {
+        m_value.emplace(std::forward<U>(value));
+    }
+
+    T result()
+    {
+        rethrowIfFailed();
+        return std::move(*m_value);
+    }
+
+private:
+    std::optional<T>          m_value;
+};
+
+template<>
+class CoPromise<void> : public CoPromiseBase
+{
+public:
+    CoTask<void> get_return_object();
+
+    void return_void() {}
+
+    void result()
+    {
+        rethrowIfFailed();
+    }
+};
+
+/**
+ * A coroutine nobody awaits, its frame is freed when it finishes.
+ */
+struct Detached
+{
+    struct promise_type : PooledFrame
+    {
+        Detached get_return_object() const noexcept { return Detached(); }
+        std::suspend_never initial_suspend() const noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() const noexcept { return std::suspend_never(); }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+inline Detached runDetached(CoTask<void> task);
+
+template<typename T>
+Detached runAndFulfil(CoTask<T> task, std::promise<T>& promise);
+
+} // namespace detail
+
+/**
+ * A lazily started coroutine returning T.
+ *
+ * The body does not run until the task is awaited. When it finishes, the
+ * awaiting coroutine resumes inline on the same thread, an exception
+ * thrown by the body is rethrown to the awaiter. Together with
+ * co_await WorkQueue::schedule() this lets thousands of logical operations
+ * wait on each other without a thread or a std::function per step.
+ *
+ *     CoTask<int> fetchSize(HttpRequest::pointer request)
+ *     {
+ *         auto response = co_await HttpClient::getInstance()->sendRequest(request);
+ *         co_await WorkQueue::getInstance()->schedule();
+ *         co_return parse(response);
+ *     }
+ */
+template<typename T>
+class CoTask : noncopyable
+{
+public:
+    typedef detail::CoPromise<T>                 promise_type;
+    typedef std::coroutine_handle<promise_type>  handle_type;
+
+    CoTask(CoTask&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+    {
+    }
+
+    CoTask& operator=(CoTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~CoTask()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    struct Awaiter
+    {
+        handle_type handle;
+
+        bool await_ready() const noexcept { return !handle || handle.done(); }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            // Start the task right away, it resumes the awaiting coroutine when done.
+            handle.promise().setContinuation(awaiting);
+            return handle;
+        }
+
+        T await_resume() { return handle.promise().result(); }
+    };
+
+    Awaiter operator co_await() const noexcept { return Awaiter{ m_handle }; }
+
+private:
+    friend class detail::CoPromise<T>;
+
+    explicit CoTask(handle_type handle) : m_handle(handle) {}
+
+    handle_type m_handle;
+};
+
+namespace detail {
+
+template<typename T>
+CoTask<T> CoPromise<T>::get_return_object()
+{
+    return CoTask<T>(std::coroutine_handle<CoPromise<T> >::from_promise(*this));
+}
+
+inline CoTask<void> CoPromise<void>::get_return_object()
+{
+    return CoTask<void>(std::coroutine_handle<CoPromise<void> >::from_promise(*this));
+}
+
+inline Detached runDetached(CoTask<void> task)
+{
+    co_await task;
+}
+
+template<typename T>
+Detached runAndFulfil(CoTask<T> task, std::promise<T>& promise)
+{
+    try
+    {
+        if constexpr (std::is_void<T>::value)
+        {
+            co_await task;
+            promise.set_value();
+        }
+        else
+        {
+            promise.set_value(co_await task);
+        }
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Start a task nobody awaits. It runs on the calling thread until
+ *        its first suspension, an exception escaping it terminates.
+ */
+inline void spawn(CoTask<void> task)
+{
+    detail::runDetached(std::move(task));
+}
+
+/**
+ * @brief Run a task and block the calling thread until it finishes.
+ *        Do not call it from a WorkQueue thread the task depends on.
+ * @return The result of the task, its exception is rethrown.
+ */
+template<typename T>
+T syncWait(CoTask<T> task)
+{
+    std::promise<T> promise;
+    std::future<T> future = promise.get_future();
+    detail::runAndFulfil(std::move(task), promise);
+    return future.get();
+}
+
+} // namespace Foundation
+
+#endif // FOUNDATION_HAS_COROUTINES
+
+#endif // Foundation_Coroutine_h
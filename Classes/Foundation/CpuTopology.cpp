@@ -0,0 +1,188 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include <thread>
+#include "CpuTopology.h"
+
+#if defined(_WIN32)
+    #include <windows.h>
+#elif defined(__linux__)
+    #include <sched.h>
+    #include <fstream>
+    #include <sstream>
+    #include <string>
+#endif
+
+namespace Foundation {
+
+#if defined(__linux__)
+namespace {
+
+/**
+ * Parse a sysfs CPU list like "0-3,8-11".
+ */
+std::vector<size_t> readCpuList(const std::string& path)
+{
+    std::vector<size_t> cpus;
+    std::ifstream file(path.c_str());
+    std::string list;
+    if (!std::getline(file, list))
+    {
+        return cpus;
+    }
+
+    std::istringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        size_t first = 0;
+        size_t last = 0;
+        char dash = 0;
+        std::istringstream item(range);
+        if (!(item >> first))
+        {
+            continue;
+        }
+        last = first;
+        if (item >> dash >> last && dash != '-')
+        {
+            last = first;
+        }
+        for (size_t cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+} // namespace
+#endif
+
+CpuTopology::CpuTopology()
+{
+#if defined(_WIN32)
+    ULONG highest = 0;
+    if (GetNumaHighestNodeNumber(&highest))
+    {
+        for (ULONG node = 0; node <= highest; ++node)
+        {
+            ULONGLONG mask = 0;
+            if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask) || mask == 0)
+            {
+                continue;
+            }
+            std::vector<size_t> cpus;
+            for (size_t cpu = 0; cpu < 64; ++cpu)
+            {
+                if (mask & (ULONGLONG(1) << cpu))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+            m_nodeCpus.push_back(cpus);
+        }
+    }
+#elif defined(__linux__)
+    std::vector<size_t> nodes = readCpuList("/sys/devices/system/node/online");
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        std::ostringstream path;
+        path << "/sys/devices/system/node/node" << nodes[i] << "/cpulist";
+        std::vector<size_t> cpus = readCpuList(path.str());
+        if (!cpus.empty())
+        {
+            m_nodeCpus.push_back(cpus);
+        }
+    }
+#endif
+
+    if (m_nodeCpus.empty())
+    {
+        size_t nCpuCount = std::thread::hardware_concurrency();
+        m_nodeCpus.push_back(std::vector<size_t>());
+        for (size_t cpu = 0; cpu < (nCpuCount > 0 ? nCpuCount : 1); ++cpu)
+        {
+            m_nodeCpus[0].push_back(cpu);
+        }
+    }
+
+    for (size_t node = 0; node < m_nodeCpus.size(); ++node)
+    {
+        for (size_t i = 0; i < m_nodeCpus[node].size(); ++i)
+        {
+            size_t cpu = m_nodeCpus[node][i];
+            if (cpu >= m_cpuNodes.size())
+            {
+                m_cpuNodes.resize(cpu + 1, 0);
+            }
+            m_cpuNodes[cpu] = node;
+        }
+    }
+}
+
+size_t CpuTopology::getNodeOfCpu(size_t nCpu) const
+{
+    return nCpu < m_cpuNodes.size() ? m_cpuNodes[nCpu] : 0;
+}
+
+size_t CpuTopology::getCurrentNode() const
+{
+    if (m_nodeCpus.size() == 1)
+    {
+        return 0;
+    }
+#if defined(_WIN32)
+    return getNodeOfCpu(GetCurrentProcessorNumber());
+#elif defined(__linux__)
+    int cpu = sched_getcpu();
+    return cpu >= 0 ? getNodeOfCpu(static_cast<size_t>(cpu)) : 0;
+#else
+    return 0;
+#endif
+}
+
+bool CpuTopology::setCurrentThreadAffinity(const std::vector<size_t>& cpus) const
+{
+    const std::vector<size_t>* pCpus = &cpus;
+    std::vector<size_t> all;
+    if (cpus.empty())
+    {
+        for (size_t node = 0; node < m_nodeCpus.size(); ++node)
+        {
+            all.insert(all.end(), m_nodeCpus[node].begin(), m_nodeCpus[node].end());
+        }
+        pCpus = &all;
+    }
+
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (size_t i = 0; i < pCpus->size(); ++i)
+    {
+        if ((*pCpus)[i] < sizeof(DWORD_PTR) * 8)
+        {
+            mask |= DWORD_PTR(1) << (*pCpus)[i];
+        }
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < pCpus->size(); ++i)
+    {
+        if ((*pCpus)[i] < CPU_SETSIZE)
+        {
+            CPU_SET((*pCpus)[i], &set);
+        }
+    }
+    return CPU_COUNT(&set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+} // namespace Foundation
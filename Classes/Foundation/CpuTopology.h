@@ -0,0 +1,65 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_CpuTopology_h
+#define Foundation_CpuTopology_h
+
+#include <cstddef>
+#include <vector>
+#include "Singleton.h"
+
+namespace Foundation {
+
+/**
+ * The logical CPUs of the machine grouped by NUMA node.
+ *
+ * Nodes without CPUs are left out, so node indices run from 0 to
+ * getNodeCount() - 1. Where the platform has no NUMA information all CPUs
+ * form a single node, and where threads cannot be pinned the affinity
+ * calls return false.
+ */
+class CpuTopology : public Singleton<CpuTopology>
+{
+public:
+    size_t getCpuCount() const { return m_cpuNodes.size(); }
+
+    size_t getNodeCount() const { return m_nodeCpus.size(); }
+
+    /**
+     * @brief Get the CPUs of a node, in ascending order.
+     */
+    const std::vector<size_t>& getCpusOfNode(size_t nNode) const { return m_nodeCpus[nNode]; }
+
+    /**
+     * @brief Get the node of a CPU, 0 for an unknown CPU.
+     */
+    size_t getNodeOfCpu(size_t nCpu) const;
+
+    /**
+     * @brief Get the node the calling thread is running on right now.
+     */
+    size_t getCurrentNode() const;
+
+    /**
+     * @brief Restrict the calling thread to a set of CPUs.
+     * @param[in] cpus  The CPUs the thread may run on, all CPUs when empty.
+     * @return false if the platform does not support pinning or refused it.
+     */
+    bool setCurrentThreadAffinity(const std::vector<size_t>& cpus) const;
+
+protected:
+    CpuTopology();
+private:
+    friend class Singleton<CpuTopology> ;
+
+    std::vector<std::vector<size_t> >   m_nodeCpus;
+    std::vector<size_t>                 m_cpuNodes;
+};
+
+} // namespace Foundation
+
+#endif // Foundation_CpuTopology_h
@@ -5,24 +5,42 @@
 
 ****************************************************************************/
 
+#include <limits>
 #include <sstream>
+#include <stdexcept>
 #include "DataStream.h"
 
 namespace Foundation
 {
 
-DataStream::DataStream()
+DataStream::DataStream():
+		m_readPos(0),
+		m_wireMode(WireMode::FIXED)
+{
+}
+
+DataStream::DataStream(WireMode mode):
+		m_readPos(0),
+		m_wireMode(mode)
 {
 }
 
 DataStream::DataStream(DataStream&& pDataStream): 
-		m_buffer(std::move(pDataStream.m_buffer))
+		m_buffer(std::move(pDataStream.m_buffer)),
+		m_readPos(pDataStream.m_readPos),
+		m_wireMode(pDataStream.m_wireMode)
 {
+	pDataStream.m_buffer.clear();
+	pDataStream.m_readPos = 0;
 }
 
 DataStream& DataStream::operator=(DataStream&& pDataStream)
 {
 	m_buffer = std::move(pDataStream.m_buffer);
+	m_readPos = pDataStream.m_readPos;
+	m_wireMode = pDataStream.m_wireMode;
+	pDataStream.m_buffer.clear();
+	pDataStream.m_readPos = 0;
 	return *this;
 }
 
@@ -34,67 +52,97 @@ DataStream& DataStream::operator<<(bool data)
 
 DataStream& DataStream::operator<<(char data)
 {
-	m_buffer.append((char*)&data, sizeof(char));
+	append((char*)&data, sizeof(char));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const uint8_t& data)
 {
-	m_buffer.append((char*)&data, sizeof(uint8_t));
+	append((char*)&data, sizeof(uint8_t));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const uint16_t& data)
 {
-	m_buffer.append((char*)&data, sizeof(uint16_t));
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		writeVarint(data);
+		return *this;
+	}
+	append((char*)&data, sizeof(uint16_t));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const uint32_t& data)
 {
-	m_buffer.append((char*)&data, sizeof(uint32_t));
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		writeVarint(data);
+		return *this;
+	}
+	append((char*)&data, sizeof(uint32_t));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const uint64_t& data)
 {
-	m_buffer.append((char*)&data, sizeof(uint64_t));
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		writeVarint(data);
+		return *this;
+	}
+	append((char*)&data, sizeof(uint64_t));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const int8_t& data)
 {
-	m_buffer.append((char*)&data, sizeof(int8_t));
+	append((char*)&data, sizeof(int8_t));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const int16_t& data)
 {
-	m_buffer.append((char*)&data, sizeof(int16_t));
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		writeVarint(zigzagEncode(data));
+		return *this;
+	}
+	append((char*)&data, sizeof(int16_t));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const int32_t& data)
 {
-	m_buffer.append((char*)&data, sizeof(int32_t));
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		writeVarint(zigzagEncode(data));
+		return *this;
+	}
+	append((char*)&data, sizeof(int32_t));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const int64_t& data)
 {
-	m_buffer.append((char*)&data, sizeof(int64_t));
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		writeVarint(zigzagEncode(data));
+		return *this;
+	}
+	append((char*)&data, sizeof(int64_t));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const float& data)
 {
-	m_buffer.append((char*)&data, sizeof(float));
+	append((char*)&data, sizeof(float));
 	return *this;
 }
 
 DataStream& DataStream::operator<<(const double& data)
 {
-	m_buffer.append((char*)&data, sizeof(double));
+	append((char*)&data, sizeof(double));
 	return *this;
 }
 
@@ -106,8 +154,8 @@ DataStream& DataStream::operator<<( const char* data )
 
 DataStream& DataStream::operator<<(const std::string& data)
 {
-	*this << data.size();
-	m_buffer.append(data.c_str(), data.size());
+	writeLength(data.size());
+	append(data.c_str(), data.size());
 	return *this;
 }
 
@@ -135,18 +183,33 @@ DataStream& DataStream::operator>>(uint8_t& data)
 
 DataStream& DataStream::operator>>(uint16_t& data)
 {
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		data = static_cast<uint16_t>(readVarint());
+		return *this;
+	}
 	read(data);
 	return *this;
 }
 
 DataStream& DataStream::operator>>(uint32_t& data)
 {
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		data = static_cast<uint32_t>(readVarint());
+		return *this;
+	}
 	read(data);
 	return *this;
 }
 
 DataStream& DataStream::operator>>(uint64_t& data)
 {
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		data = static_cast<uint64_t>(readVarint());
+		return *this;
+	}
 	read(data);
 	return *this;
 }
@@ -159,18 +222,33 @@ DataStream& DataStream::operator>>(int8_t& data)
 
 DataStream& DataStream::operator>>(int16_t& data)
 {
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		data = static_cast<int16_t>(zigzagDecode(readVarint()));
+		return *this;
+	}
 	read(data);
 	return *this;
 }
 
 DataStream& DataStream::operator>>(int32_t& data)
 {
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		data = static_cast<int32_t>(zigzagDecode(readVarint()));
+		return *this;
+	}
 	read(data);
 	return *this;
 }
 
 DataStream& DataStream::operator>>(int64_t& data)
 {
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		data = static_cast<int64_t>(zigzagDecode(readVarint()));
+		return *this;
+	}
 	read(data);
 	return *this;
 }
@@ -189,69 +267,211 @@ DataStream& DataStream::operator>>(double& data)
 
 DataStream& DataStream::operator>>(std::string& data)
 {
-	uint32_t size = 0;
-	*this >> size;
+	uint32_t size = readLength();
 
 	// Check for fake string size to prevent memory hacks
-	if(size > m_buffer.size())
+	if(size > this->size())
 	{
 		std::ostringstream os;
-		os << "String size (" << size << ") > packet size (" << m_buffer.size() << ")";
+		os << "String size (" << size << ") > packet size (" << this->size() << ")";
 		throw std::out_of_range(os.str());
 	}
-	if(size == 0)
+
+	data.assign(m_buffer.data() + m_readPos, size);
+	m_readPos += size;
+	return *this;
+}
+
+#if FOUNDATION_HAS_STRING_VIEW
+DataStream& DataStream::operator>>(std::string_view& data)
+{
+	uint32_t size = readLength();
+
+	if(size > this->size())
 	{
-		data = "";
-		return *this;
+		std::ostringstream os;
+		os << "String size (" << size << ") > packet size (" << this->size() << ")";
+		throw std::out_of_range(os.str());
 	}
 
-	data = m_buffer.substr(0,size);
-	data.shrink_to_fit();
-	m_buffer.erase(0,size);
+	data = std::string_view(m_buffer.data() + m_readPos, size);
+	m_readPos += size;
 	return *this;
 }
+#endif
 
 void DataStream::write(uint8_t* data, size_t pSize, int32_t pPos)
 {
 	if(pPos < 0)
 	{
-		m_buffer.append(reinterpret_cast<char*>(data), pSize);
+		append(reinterpret_cast<char*>(data), pSize);
 	}
-	else if(pPos + pSize <= m_buffer.size())
+	else if(pPos + pSize <= size())
 	{
-		std::memcpy(&m_buffer[pPos], data, pSize);
+		// Positions count from the first unread byte.
+		std::memcpy(&m_buffer[m_readPos + pPos], data, pSize);
 	}
 }
 
 void DataStream::read( uint8_t* data, size_t dataSize )
 {
-	std::memcpy(&data,&m_buffer[0],dataSize);
-	m_buffer.erase(0,dataSize);
+	const char* source = readBorrowed(dataSize);
+	if(source != nullptr)
+	{
+		std::memcpy(data, source, dataSize);
+	}
+}
+
+const char* DataStream::readBorrowed( size_t dataSize )
+{
+	if(dataSize > size())
+	{
+		return nullptr;
+	}
+	const char* data = m_buffer.data() + m_readPos;
+	m_readPos += dataSize;
+	return data;
+}
+
+void DataStream::writeVarint(uint64_t value)
+{
+	char bytes[10];
+	size_t size = 0;
+	while(value >= 0x80)
+	{
+		bytes[size++] = static_cast<char>(value | 0x80);
+		value >>= 7;
+	}
+	bytes[size++] = static_cast<char>(value);
+	append(bytes, size);
+}
+
+uint64_t DataStream::readVarint()
+{
+	if(size() < 10)
+	{
+		return readVarintSlow();
+	}
+
+	// At least 10 bytes are left, so the longest varint can be decoded
+	// without bounds checks, one test per byte. Each step adds the new
+	// byte with its continuation bit and then subtracts that bit, which
+	// keeps the common short cases to a handful of instructions.
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(m_buffer.data() + m_readPos);
+	const uint8_t* begin = p;
+	uint64_t byte = *p++;
+	uint64_t result = byte;
+	if(byte < 0x80) goto done;
+	result -= 0x80;
+	byte = *p++; result += byte << 7;  if(byte < 0x80) goto done;
+	result -= 0x80ULL << 7;
+	byte = *p++; result += byte << 14; if(byte < 0x80) goto done;
+	result -= 0x80ULL << 14;
+	byte = *p++; result += byte << 21; if(byte < 0x80) goto done;
+	result -= 0x80ULL << 21;
+	byte = *p++; result += byte << 28; if(byte < 0x80) goto done;
+	result -= 0x80ULL << 28;
+	byte = *p++; result += byte << 35; if(byte < 0x80) goto done;
+	result -= 0x80ULL << 35;
+	byte = *p++; result += byte << 42; if(byte < 0x80) goto done;
+	result -= 0x80ULL << 42;
+	byte = *p++; result += byte << 49; if(byte < 0x80) goto done;
+	result -= 0x80ULL << 49;
+	byte = *p++; result += byte << 56; if(byte < 0x80) goto done;
+	result -= 0x80ULL << 56;
+	byte = *p++; result += byte << 63; if(byte < 0x80) goto done;
+
+	// More than 10 bytes, not a varint we wrote.
+	return 0;
+
+done:
+	m_readPos += p - begin;
+	return result;
+}
+
+uint64_t DataStream::readVarintSlow()
+{
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(m_buffer.data() + m_readPos);
+	const size_t left = size();
+	uint64_t result = 0;
+	for(size_t i = 0; i < left; ++i)
+	{
+		result |= static_cast<uint64_t>(p[i] & 0x7F) << (7 * i);
+		if(p[i] < 0x80)
+		{
+			m_readPos += i + 1;
+			return result;
+		}
+	}
+	// Truncated.
+	return 0;
+}
+
+void DataStream::writeLength(size_t size)
+{
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		writeVarint(size);
+		return;
+	}
+	*this << static_cast<uint32_t>(size);
+}
+
+uint32_t DataStream::readLength()
+{
+	if(m_wireMode == WireMode::COMPACT)
+	{
+		// A varint may carry 64 bits, a larger length is a broken or forged packet
+		uint64_t size = readVarint();
+		if(size > std::numeric_limits<uint32_t>::max())
+		{
+			std::ostringstream os;
+			os << "Length (" << size << ") > " << std::numeric_limits<uint32_t>::max();
+			throw std::out_of_range(os.str());
+		}
+		return static_cast<uint32_t>(size);
+	}
+	uint32_t size = 0;
+	read(size);
+	return size;
 }
 
 void DataStream::clear()
 {
 	m_buffer.clear();
+	m_readPos = 0;
 }
 
 void DataStream::reset(const std::string& data)
 {
 	m_buffer.clear();
-	m_buffer.append(&data[0], data.size());
+	m_readPos = 0;
+	m_buffer.append(data.data(), data.size());
 }
 
 size_t DataStream::size()
 {
-	return (int32_t)m_buffer.size();
+	return m_buffer.size() - m_readPos;
+}
+
+void DataStream::compact()
+{
+	if(m_readPos != 0)
+	{
+		m_buffer.erase(0, m_readPos);
+		m_readPos = 0;
+	}
 }
 
 const std::string& DataStream::getBuffer()
 {
+	compact();
 	return m_buffer;
 }
 
 const char* DataStream::c_str()
 {
+	compact();
 	return m_buffer.c_str();
 }
 
@@ -9,18 +9,44 @@
 #define Foundation_DataStream1_h
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <list>
 #include <map>
 #include <unordered_map>
 #include <string>
+#include "FoundationMacros.h"
+
+#if FOUNDATION_HAS_STRING_VIEW
+	#include <string_view>
+#endif
+#if FOUNDATION_HAS_SPAN
+	#include <span>
+#endif
 
 namespace Foundation
 {
+/**
+ * A binary stream: writes append to the buffer, reads move a cursor over
+ * it. Read bytes stay in the buffer until the stream is written after
+ * being fully read, or until getBuffer/c_str hand the unread part out, so
+ * decoding a message is linear in its size.
+ */
 class  DataStream
 {
 public:
+	/**
+	 * How integers and lengths are laid out, both ends of a stream must
+	 * agree on it.
+	 */
+	enum class WireMode
+	{
+		FIXED,		///< native width integers, uint32_t lengths
+		COMPACT,	///< LEB128 varints, zigzag for signed, varint lengths
+	};
+
 	DataStream();
+	explicit DataStream(WireMode mode);
 	DataStream(DataStream&& pDataStream);
 	DataStream& operator=(DataStream&& pDataStream);
 	DataStream& operator<<(bool data);
@@ -52,6 +78,15 @@ public:
 	DataStream& operator>>(double& data);
 	DataStream& operator>>(std::string& data);
 
+#if FOUNDATION_HAS_STRING_VIEW
+	/**
+	 * Read a string without copying it, the view borrows from the buffer
+	 * and is valid until the stream is next written, cleared or reset,
+	 * or getBuffer/c_str is called.
+	 */
+	DataStream& operator>>(std::string_view& data);
+#endif
+
 	template <typename K, typename V>
 	DataStream& operator<<(const std::map<K, V>& data)
 	{
@@ -102,16 +137,35 @@ public:
 
 	void write			(uint8_t* data, size_t pSize, int32_t pPos = -1);
 
+	/**
+	 * Switch the layout used by later reads and writes. 8-bit values,
+	 * floats and raw bytes are the same in both modes.
+	 */
+	void     setWireMode(WireMode mode) { m_wireMode = mode; }
+	WireMode getWireMode() const { return m_wireMode; }
+
+	/**
+	 * Write value as a LEB128 varint of 1 to 10 bytes, whatever the mode.
+	 */
+	void writeVarint(uint64_t value);
+
+	/**
+	 * Read a LEB128 varint of 1 to 10 bytes, whatever the mode.
+	 * @return 0 if the varint is truncated or longer than 10 bytes,
+	 *         nothing is read then.
+	 */
+	uint64_t readVarint();
+
 	template< typename T >
 	void read(T& data)
 	{
-		if(m_buffer.size() < sizeof(T))
+		if(m_buffer.size() - m_readPos < sizeof(T))
 		{
 			data = 0;
 			return;
 		}
-		std::memcpy(&data,&m_buffer[0],sizeof(T));
-		m_buffer.erase(0,sizeof(T));
+		std::memcpy(&data, m_buffer.data() + m_readPos, sizeof(T));
+		m_readPos += sizeof(T);
 	}
 
 	template< typename T >
@@ -124,20 +178,82 @@ public:
 
 	void read(uint8_t* data, size_t dataSize);
 
+	/**
+	 * Read dataSize bytes without copying them, the pointer borrows from
+	 * the buffer like the string_view read.
+	 * @return nullptr if fewer bytes are left, nothing is read then.
+	 */
+	const char* readBorrowed(size_t dataSize);
+
+#if FOUNDATION_HAS_SPAN
+	/**
+	 * Read dataSize bytes without copying them, see readBorrowed.
+	 * @return an empty span if fewer bytes are left.
+	 */
+	std::span<const uint8_t> readSpan(size_t dataSize)
+	{
+		const char* data = readBorrowed(dataSize);
+		return data ? std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(data), dataSize) : std::span<const uint8_t>();
+	}
+#endif
+
 
 	void   clear();
 	void   reset(const std::string& data);
+	/**
+	 * The number of bytes not read yet.
+	 */
 	size_t size();
 
 	const char* c_str();
 
+	/**
+	 * The bytes not read yet.
+	 */
 	const std::string&	getBuffer();
 
 private:
+	/**
+	 * Append to the buffer, dropping the bytes already read first once they
+	 * are at least half of it. A stream written and read in turns stays
+	 * bounded, and the unread bytes moved are never more than those read.
+	 */
+	void append(const char* data, size_t dataSize)
+	{
+		if(m_readPos != 0 && m_readPos * 2 >= m_buffer.size())
+		{
+			compact();
+		}
+		m_buffer.append(data, dataSize);
+	}
+
+	/**
+	 * Drop the bytes already read from the buffer.
+	 */
+	void compact();
+
+	/**
+	 * Decode a varint when fewer than 10 bytes are left.
+	 */
+	uint64_t readVarintSlow();
+
+	void     writeLength(size_t size);
+	uint32_t readLength();
+
+	static uint64_t zigzagEncode(int64_t value)
+	{
+		return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	}
+
+	static int64_t zigzagDecode(uint64_t value)
+	{
+		return static_cast<int64_t>((value >> 1) ^ (0 - (value & 1)));
+	}
+
 	template<typename C>
 	DataStream& writeSequenceContainer(const C& data)
 	{
-		*this << data.size();
+		writeLength(data.size());
 		for(auto iter : data)
 		{
 			*this << iter;
@@ -148,8 +264,7 @@ private:
 	template<typename C, typename V>
 	DataStream& readSequenceContainer(C& data)
 	{
-		uint32_t size;
-		*this >> size;
+		uint32_t size = readLength();
 		//if(size > 1000)
 		//    return *this;
 
@@ -166,7 +281,7 @@ private:
 	template<typename C>
 	DataStream& writeAssociativeContainer(const C& data)
 	{
-		*this << data.size();
+		writeLength(data.size());
 		for(auto& iter : data)
 		{
 			*this << iter.first << iter.second;
@@ -177,8 +292,7 @@ private:
 	template<typename C ,typename K, typename V>
 	DataStream& readAssociativeContainer(C& data)
 	{
-		uint32_t size;
-		*this >> size;
+		uint32_t size = readLength();
 		//if(size > 1000)
 		//    return *this;
 
@@ -194,6 +308,8 @@ private:
 
 protected:
 	std::string		      m_buffer;
+	size_t			      m_readPos;	///< bytes of m_buffer already read
+	WireMode		      m_wireMode;
 };
 
 } // namespace Foundation
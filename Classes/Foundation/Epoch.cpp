@@ -0,0 +1,188 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "FoundationMacros.h"
+#include "Epoch.h"
+
+namespace Foundation {
+
+namespace {
+
+/**
+ * The pin of one thread. Records are never freed, the record of an exited
+ * thread is taken over by the next new thread.
+ */
+struct Record
+{
+    std::atomic<uint64_t>   epoch;   ///< the epoch pinned, 0 while unpinned
+    std::atomic<bool>       inUse;
+    Record*                 next;
+    unsigned                depth;   ///< nested guards, owner only
+    char                    pad[FOUNDATION_CACHELINE_SIZE];
+
+    Record() : epoch(0), inUse(true), next(nullptr), depth(0) {}
+};
+
+struct Retired
+{
+    uint64_t                     epoch;
+    std::shared_ptr<const void>  object;
+};
+
+// Bumped by every retire, a reader pinned later can't see the retired object.
+std::atomic<uint64_t>       s_epoch(1);
+std::atomic<Record*>        s_records(nullptr);
+
+std::mutex                  s_retiredMutex;
+std::vector<Retired>        s_retired;
+
+// The epoch of the newest retired object, 0 when none is left.
+std::atomic<uint64_t>       s_newestRetired(0);
+
+FOUNDATION_THREAD_LOCAL Record* s_record;
+
+Record* acquireRecord()
+{
+    for (Record* pRecord = s_records.load(); pRecord != nullptr; pRecord = pRecord->next)
+    {
+        if (!pRecord->inUse.load(std::memory_order_relaxed) && !pRecord->inUse.exchange(true))
+        {
+            return pRecord;
+        }
+    }
+
+    Record* pRecord = new Record;
+    Record* pHead = s_records.load();
+    do
+    {
+        pRecord->next = pHead;
+    } while (!s_records.compare_exchange_weak(pHead, pRecord));
+    return pRecord;
+}
+
+#if !defined(_MSC_VER) || _MSC_VER >= 1900
+// Hands the record back when the thread exits. On older compilers the
+// record of an exited thread is not reused.
+struct RecordGuard
+{
+    ~RecordGuard()
+    {
+        if (s_record != nullptr)
+        {
+            s_record->inUse.store(false, std::memory_order_release);
+            s_record = nullptr;
+        }
+    }
+
+    void arm() {}
+};
+
+thread_local RecordGuard    s_recordGuard;
+#endif
+
+} // namespace
+
+void Epoch::pin()
+{
+    Record* pRecord = s_record;
+    if (pRecord == nullptr)
+    {
+        pRecord = s_record = acquireRecord();
+#if !defined(_MSC_VER) || _MSC_VER >= 1900
+        s_recordGuard.arm();
+#endif
+    }
+    if (pRecord->depth++ == 0)
+    {
+        // Sequentially consistent, so the pin is seen by a writer scanning
+        // after it unpublished any object this reader goes on to load.
+        pRecord->epoch.store(s_epoch.load());
+    }
+}
+
+void Epoch::unpin()
+{
+    Record* pRecord = s_record;
+    if (--pRecord->depth == 0)
+    {
+        uint64_t epoch = pRecord->epoch.load(std::memory_order_relaxed);
+        pRecord->epoch.store(0, std::memory_order_release);
+
+        // A reader pinned before a retire may be the last one holding the
+        // object back, it releases it instead of waiting for the next retire.
+        // The check is relaxed, a missed one only delays the release.
+        if (epoch <= s_newestRetired.load(std::memory_order_relaxed))
+        {
+            collect();
+        }
+    }
+}
+
+void Epoch::retire(std::shared_ptr<const void> object)
+{
+    if (!object)
+    {
+        return;
+    }
+    Retired retired;
+    retired.epoch = s_epoch.fetch_add(1);
+    retired.object = std::move(object);
+    {
+        std::lock_guard<std::mutex> lock(s_retiredMutex);
+        if (retired.epoch > s_newestRetired.load(std::memory_order_relaxed))
+        {
+            s_newestRetired.store(retired.epoch, std::memory_order_relaxed);
+        }
+        s_retired.push_back(std::move(retired));
+    }
+    collect();
+}
+
+void Epoch::collect()
+{
+    // A reader pinned at an epoch after the one of a retire started after it.
+    // Objects retired once the scan started are newer than the epoch read
+    // here, the scan may have missed their readers.
+    uint64_t oldest = s_epoch.load();
+    for (Record* pRecord = s_records.load(); pRecord != nullptr; pRecord = pRecord->next)
+    {
+        uint64_t epoch = pRecord->epoch.load();
+        if (epoch != 0 && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+
+    // The references are dropped outside the lock, a destructor may retire.
+    std::vector<std::shared_ptr<const void> > released;
+    {
+        std::lock_guard<std::mutex> lock(s_retiredMutex);
+        uint64_t kept = 0;
+        size_t nKept = 0;
+        for (size_t i = 0; i < s_retired.size(); ++i)
+        {
+            if (s_retired[i].epoch < oldest)
+            {
+                released.push_back(std::move(s_retired[i].object));
+                continue;
+            }
+            kept = std::max(kept, s_retired[i].epoch);
+            if (nKept++ != i)
+            {
+                s_retired[nKept - 1] = std::move(s_retired[i]);
+            }
+        }
+        s_retired.resize(nKept);
+        s_newestRetired.store(kept, std::memory_order_relaxed);
+    }
+}
+
+} // namespace Foundation
@@ -0,0 +1,101 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_Epoch_h
+#define Foundation_Epoch_h
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include "noncopyable.hpp"
+
+namespace Foundation {
+
+/**
+ * Epoch based reclamation of objects that are read without a lock.
+ *
+ * A reader pins its thread with an Epoch::Guard while it uses the pointers
+ * it loaded from shared state. A writer that unpublishes an object hands
+ * its reference to retire(), the reference is dropped once every thread
+ * pinned at that point has unpinned. Pinning reads the global epoch and
+ * writes it to a record of the calling thread, no lock is taken and no
+ * reference count is touched, so readers never contend with each other.
+ *
+ * Guards nest, only the outermost one pins. A thread that stays pinned
+ * holds back every object retired meanwhile, by any writer, so a guard
+ * should cover the read and no more.
+ */
+class Epoch : noncopyable
+{
+public:
+    class Guard : noncopyable
+    {
+    public:
+        Guard() { Epoch::pin(); }
+
+        ~Guard() { Epoch::unpin(); }
+    };
+
+    /**
+     * @brief Drop a reference once no pinned reader may still use the object,
+     *        and the references retired before that became safe.
+     */
+    static void retire(std::shared_ptr<const void> object);
+
+    /**
+     * @brief Drop the retired references that became safe.
+     */
+    static void collect();
+
+private:
+    static void pin();
+
+    static void unpin();
+};
+
+/**
+ * A shared object published to readers holding an Epoch::Guard. Writers
+ * own the object through a shared_ptr and must be serialized by the caller.
+ */
+template<typename T>
+class EpochPtr : noncopyable
+{
+public:
+    explicit EpochPtr(std::shared_ptr<T> object)
+        : m_owner(std::move(object))
+        , m_pointer(m_owner.get())
+    {
+    }
+
+    /**
+     * @brief The current object, valid while the calling thread holds a Guard.
+     */
+    T* get() const { return m_pointer.load(); }
+
+    /**
+     * @brief The owning pointer of the current object. Writer only.
+     */
+    const std::shared_ptr<T>& owner() const { return m_owner; }
+
+    /**
+     * @brief Publish an object and retire the current one. Writer only.
+     */
+    void store(std::shared_ptr<T> object)
+    {
+        m_pointer.store(object.get());
+        m_owner.swap(object);
+        Epoch::retire(std::move(object));
+    }
+
+private:
+    std::shared_ptr<T>      m_owner;
+    std::atomic<T*>         m_pointer;
+};
+
+} // namespace Foundation
+
+#endif // Foundation_Epoch_h
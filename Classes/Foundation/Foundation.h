@@ -12,18 +12,28 @@
 #include "base64.h"
 #include "BitStream.h"
 #include "Buffer.h"
+#include "Coroutine.h"
+#include "CpuTopology.h"
 #include "DataStream.h"
 #include "Endian.h"
+#include "Epoch.h"
 #include "Exception.h"
 #include "FoundationMacros.h"
 #include "Functional.h"
+#include "Histogram.h"
 #include "Math.hpp"
 #include "md5.hpp"
 #include "noncopyable.hpp"
+#include "Parallel.h"
 #include "RandomGenerator.h"
+#include "RingQueue.h"
 #include "Runnable.h"
 #include "sha1.hpp"
 #include "Singleton.h"
+#include "Strand.h"
+#include "Task.h"
+#include "TaskGraph.h"
+#include "TimerWheel.h"
 #include "Unicode.h"
 #include "WorkQueue.h"
 
@@ -22,4 +22,53 @@
     #define DEPRECATED_ATTRIBUTE
 #endif 
 
+/*
+ * thread local storage, vs2012/vs2013 do not support the C++11 'thread_local' keyword.
+ */
+#if defined(_MSC_VER) && _MSC_VER < 1900
+    #define FOUNDATION_THREAD_LOCAL __declspec(thread)
+#else
+    #define FOUNDATION_THREAD_LOCAL thread_local
+#endif
+
+/*
+ * cache line size, used to pad data written by different threads.
+ */
+#define FOUNDATION_CACHELINE_SIZE 64
+
+/*
+ * C++20 coroutines, the awaitables of WorkQueue, HttpClient and TcpConnection
+ * and Coroutine.h are only compiled when the compiler supports them.
+ */
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+    #define FOUNDATION_HAS_COROUTINES 1
+#else
+    #define FOUNDATION_HAS_COROUTINES 0
+#endif
+
+/*
+ * C++17 std::string_view and C++20 std::span, DataStream hands out views of
+ * its buffer through them when the compiler has them.
+ */
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L
+    #define FOUNDATION_HAS_STRING_VIEW 1
+#else
+    #define FOUNDATION_HAS_STRING_VIEW 0
+#endif
+
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L) || __cplusplus >= 202002L
+    #define FOUNDATION_HAS_SPAN 1
+#else
+    #define FOUNDATION_HAS_SPAN 0
+#endif
+
+/*
+ * C++17 std::invoke_result, std::result_of is removed from C++20.
+ */
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L
+    #define FOUNDATION_HAS_INVOKE_RESULT 1
+#else
+    #define FOUNDATION_HAS_INVOKE_RESULT 0
+#endif
+
 #endif // Foundation_FoundationMacros_h
\ No newline at end of file
@@ -0,0 +1,141 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include "Histogram.h"
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace Foundation {
+
+namespace {
+
+/**
+ * Index of the highest set bit, value must not be 0.
+ */
+inline size_t highestBit(uint64_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    if (value >> 32)
+    {
+        _BitScanReverse(&index, static_cast<unsigned long>(value >> 32));
+        return index + 32;
+    }
+    _BitScanReverse(&index, static_cast<unsigned long>(value));
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+} // namespace
+
+Histogram::Snapshot::Snapshot()
+    : count(0)
+    , sum(0)
+    , max(0)
+{
+    std::fill(buckets, buckets + BUCKET_COUNT, 0);
+}
+
+void Histogram::Snapshot::merge(const Snapshot& other)
+{
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+uint64_t Histogram::Snapshot::percentile(double p) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    p = std::min(std::max(p, 0.0), 100.0);
+    uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * count));
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return std::min(bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+Histogram::Histogram()
+{
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+void Histogram::mergeInto(Snapshot& snapshot) const
+{
+    // The count is taken from the buckets, so it agrees with them even
+    // while values are being recorded.
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        uint64_t n = m_buckets[i].load(std::memory_order_relaxed);
+        snapshot.buckets[i] += n;
+        snapshot.count += n;
+    }
+    snapshot.sum += m_sum.load(std::memory_order_relaxed);
+    snapshot.max = std::max(snapshot.max, m_max.load(std::memory_order_relaxed));
+}
+
+size_t Histogram::bucketOf(uint64_t value)
+{
+    if (value < SUB_COUNT)
+    {
+        return static_cast<size_t>(value);
+    }
+    // The top SUB_BITS + 1 bits pick the bucket inside the power of two.
+    size_t exponent = highestBit(value);
+    size_t shift = exponent - SUB_BITS;
+    return (shift + 1) * SUB_COUNT + static_cast<size_t>((value >> shift) - SUB_COUNT);
+}
+
+uint64_t Histogram::bucketLowerBound(size_t nBucket)
+{
+    if (nBucket < SUB_COUNT)
+    {
+        return nBucket;
+    }
+    size_t shift = nBucket / SUB_COUNT - 1;
+    return (static_cast<uint64_t>(nBucket % SUB_COUNT + SUB_COUNT)) << shift;
+}
+
+uint64_t Histogram::bucketUpperBound(size_t nBucket)
+{
+    if (nBucket < SUB_COUNT)
+    {
+        return nBucket;
+    }
+    size_t shift = nBucket / SUB_COUNT - 1;
+    return bucketLowerBound(nBucket) + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+} // namespace Foundation
@@ -0,0 +1,98 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_Histogram_h
+#define Foundation_Histogram_h
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include "noncopyable.hpp"
+
+namespace Foundation {
+
+/**
+ * A lock-free log-linear histogram of 64 bit values.
+ *
+ * Values below SUB_COUNT have a bucket each. Above that, every power of two
+ * is split into SUB_COUNT equal buckets, so a bucket is never wider than
+ * 1/SUB_COUNT of its values (about 6%) and the whole 64 bit range fits in
+ * BUCKET_COUNT buckets. Recording is a few relaxed atomic adds; a thread
+ * that wants the numbers copies them into a Snapshot, snapshots of many
+ * histograms merge into one.
+ */
+class Histogram : noncopyable
+{
+public:
+    enum
+    {
+        SUB_BITS     = 4,
+        SUB_COUNT    = 1 << SUB_BITS,
+        BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_COUNT,
+    };
+
+    /**
+     * A plain copy of one or more histograms.
+     */
+    struct Snapshot
+    {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t buckets[BUCKET_COUNT];
+
+        Snapshot();
+
+        void merge(const Snapshot& other);
+
+        /**
+         * @brief The value below which p percent of the values fall,
+         *        accurate to a bucket width.
+         * @param[in] p  The percentile, 0 to 100.
+         */
+        uint64_t percentile(double p) const;
+
+        double mean() const { return count != 0 ? static_cast<double>(sum) / count : 0.0; }
+    };
+
+    Histogram();
+
+    void record(uint64_t value)
+    {
+        m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /**
+     * @brief Add the values recorded so far to a snapshot.
+     */
+    void mergeInto(Snapshot& snapshot) const;
+
+    /**
+     * @brief The sum of all recorded values.
+     */
+    uint64_t getSum() const { return m_sum.load(std::memory_order_relaxed); }
+
+    static size_t bucketOf(uint64_t value);
+
+    static uint64_t bucketLowerBound(size_t nBucket);
+
+    static uint64_t bucketUpperBound(size_t nBucket);
+
+private:
+    std::atomic<uint64_t>   m_buckets[BUCKET_COUNT];
+    std::atomic<uint64_t>   m_sum;
+    std::atomic<uint64_t>   m_max;
+};
+
+} // namespace Foundation
+
+#endif // Foundation_Histogram_h
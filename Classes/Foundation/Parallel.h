@@ -0,0 +1,344 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_Parallel_h
+#define Foundation_Parallel_h
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "WorkQueue.h"
+
+namespace Foundation {
+
+namespace detail {
+
+/**
+ * Shared state of a parallel loop over [0, count).
+ *
+ * The caller and the helper tasks claim chunks with guided scheduling: a
+ * chunk is the remaining work divided by twice the number of participants,
+ * but never less than the grain. Chunks start large and shrink towards the
+ * end of the range, so the load balances itself without many claims.
+ */
+template<typename Body>
+class ParallelLoop
+{
+public:
+    ParallelLoop(size_t count, size_t grain, size_t participants, const Body& body)
+        : m_count(count)
+        , m_grain(grain)
+        , m_divisor(participants * 2)
+        , m_next(0)
+        , m_done(0)
+        , m_body(body)
+    {
+    }
+
+    /**
+     * @brief Claim and run chunks until the range is exhausted.
+     */
+    void work()
+    {
+        size_t begin = 0;
+        size_t end = 0;
+        while (claim(begin, end))
+        {
+            try
+            {
+                m_body(begin, end);
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+            complete(end - begin);
+        }
+    }
+
+    /**
+     * @brief Block until every chunk has completed, rethrow the first error.
+     */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (m_done != m_count)
+        {
+            m_finished.wait(lock);
+        }
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    bool claim(size_t& begin, size_t& end)
+    {
+        size_t next = m_next.load();
+        do
+        {
+            if (next >= m_count)
+            {
+                return false;
+            }
+            size_t chunk = std::max(m_grain, (m_count - next) / m_divisor);
+            end = std::min(m_count, next + chunk);
+        } while (!m_next.compare_exchange_weak(next, end));
+        begin = next;
+        return true;
+    }
+
+    void complete(size_t n)
+    {
+        if (m_done.fetch_add(n) + n == m_count)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_finished.notify_all();
+        }
+    }
+
+    void fail(std::exception_ptr error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_error)
+            {
+                m_error = error;
+            }
+        }
+        // Give up the unclaimed rest of the range.
+        size_t next = m_next.exchange(m_count);
+        if (next < m_count)
+        {
+            complete(m_count - next);
+        }
+    }
+
+private:
+    const size_t              m_count;
+    const size_t              m_grain;
+    const size_t              m_divisor;
+    std::atomic<size_t>       m_next;
+    std::atomic<size_t>       m_done;
+    Body                      m_body;
+    std::mutex                m_lock;
+    std::condition_variable   m_finished;
+    std::exception_ptr        m_error;
+};
+
+/**
+ * Run body(begin, end) over the chunks of [0, count) on the queue's
+ * threads, the calling thread takes part and returns when all is done.
+ */
+template<typename Body>
+void parallelRun(size_t count, size_t grain, const Body& body, WorkQueue* pQueue)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (pQueue == nullptr)
+    {
+        pQueue = WorkQueue::getInstance();
+    }
+
+    size_t participants = pQueue->getThreadCount() + 1;
+    if (grain == 0)
+    {
+        // About eight chunks per participant at the smallest.
+        grain = std::max<size_t>(1, count / (participants * 8));
+    }
+    if (count <= grain)
+    {
+        body(0, count);
+        return;
+    }
+
+    size_t helpers = std::min(participants - 1, (count + grain - 1) / grain - 1);
+    std::shared_ptr<ParallelLoop<Body> > loop =
+        std::make_shared<ParallelLoop<Body> >(count, grain, helpers + 1, body);
+
+    // Helpers share the loop, the ones that start late find no work left.
+    std::vector<std::function<void()> > tasks(helpers, [loop]{ loop->work(); });
+    pQueue->submitBatch(tasks.begin(), tasks.end());
+
+    loop->work();
+    loop->wait();
+}
+
+} // namespace detail
+
+/**
+ * @brief Call f(i) for every i in [first, last) in parallel.
+ * @param[in] first   The first index.
+ * @param[in] last    The index past the end.
+ * @param[in] f       The loop body.
+ * @param[in] grain   The smallest number of indices run as one chunk,
+ *                    0 picks one from the range size and the pool size.
+ * @param[in] pQueue  The pool to run on, the shared WorkQueue by default.
+ */
+template<typename Index, typename Function>
+void parallelFor(Index first, Index last, const Function& f, size_t grain = 0, WorkQueue* pQueue = nullptr)
+{
+    if (!(first < last))
+    {
+        return;
+    }
+    detail::parallelRun(static_cast<size_t>(last - first), grain, [first, &f](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            f(static_cast<Index>(first + i));
+        }
+    }, pQueue);
+}
+
+/**
+ * @brief Reduce map(i) for every i in [first, last) in parallel.
+ *        reduce must be associative and commutative, identity must be
+ *        its neutral element.
+ * @return reduce over all map(i), identity for an empty range.
+ */
+template<typename Index, typename T, typename Map, typename Reduce>
+T parallelReduce(Index first, Index last, T identity, const Map& map, const Reduce& reduce,
+                 size_t grain = 0, WorkQueue* pQueue = nullptr)
+{
+    if (!(first < last))
+    {
+        return identity;
+    }
+
+    std::mutex lock;
+    T result = identity;
+    detail::parallelRun(static_cast<size_t>(last - first), grain,
+        [first, &identity, &map, &reduce, &lock, &result](size_t begin, size_t end)
+    {
+        T partial = identity;
+        for (size_t i = begin; i < end; ++i)
+        {
+            partial = reduce(partial, map(static_cast<Index>(first + i)));
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        result = reduce(result, partial);
+    }, pQueue);
+    return result;
+}
+
+/**
+ * @brief Write op(*it) for every it in [first, last) to out in parallel.
+ *        The iterators must be random access.
+ * @return The iterator past the last element written.
+ */
+template<typename InputIterator, typename OutputIterator, typename UnaryOperation>
+OutputIterator parallelTransform(InputIterator first, InputIterator last, OutputIterator out,
+                                 const UnaryOperation& op, size_t grain = 0, WorkQueue* pQueue = nullptr)
+{
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    detail::parallelRun(count, grain, [first, out, &op](size_t begin, size_t end)
+    {
+        InputIterator input = first + begin;
+        OutputIterator output = out + begin;
+        for (size_t i = begin; i < end; ++i, ++input, ++output)
+        {
+            *output = op(*input);
+        }
+    }, pQueue);
+    return out + count;
+}
+
+/**
+ * @brief Stable merge sort in parallel. The range is split into one run
+ *        per participant, runs are sorted in parallel and then merged
+ *        pairwise, all merges of a round in parallel.
+ */
+template<typename RandomIterator, typename Compare>
+void parallelSort(RandomIterator first, RandomIterator last, const Compare& comp,
+                  size_t grain = 0, WorkQueue* pQueue = nullptr)
+{
+    typedef typename std::iterator_traits<RandomIterator>::value_type value_type;
+
+    size_t count = static_cast<size_t>(last - first);
+    if (pQueue == nullptr)
+    {
+        pQueue = WorkQueue::getInstance();
+    }
+    if (grain == 0)
+    {
+        grain = 4096;
+    }
+
+    size_t runs = 1;
+    while (runs < pQueue->getThreadCount() + 1 && count / (runs * 2) >= grain)
+    {
+        runs *= 2;
+    }
+    if (runs == 1)
+    {
+        std::stable_sort(first, last, comp);
+        return;
+    }
+
+    std::vector<size_t> bounds(runs + 1);
+    for (size_t i = 0; i <= runs; ++i)
+    {
+        bounds[i] = count * i / runs;
+    }
+
+    parallelFor(size_t(0), runs, [first, &bounds, &comp](size_t run)
+    {
+        std::stable_sort(first + bounds[run], first + bounds[run + 1], comp);
+    }, 1, pQueue);
+
+    std::vector<value_type> buffer(first, last);
+    bool inBuffer = false;
+    for (size_t width = 1; width < runs; width *= 2)
+    {
+        // Merge run pairs of this round from one side to the other.
+        parallelFor(size_t(0), runs / (width * 2), [&, width](size_t pair)
+        {
+            size_t lo  = bounds[pair * width * 2];
+            size_t mid = bounds[pair * width * 2 + width];
+            size_t hi  = bounds[pair * width * 2 + width * 2];
+            if (inBuffer)
+            {
+                std::merge(std::make_move_iterator(buffer.begin() + lo), std::make_move_iterator(buffer.begin() + mid),
+                           std::make_move_iterator(buffer.begin() + mid), std::make_move_iterator(buffer.begin() + hi),
+                           first + lo, comp);
+            }
+            else
+            {
+                std::merge(std::make_move_iterator(first + lo), std::make_move_iterator(first + mid),
+                           std::make_move_iterator(first + mid), std::make_move_iterator(first + hi),
+                           buffer.begin() + lo, comp);
+            }
+        }, 1, pQueue);
+        inBuffer = !inBuffer;
+    }
+
+    if (inBuffer)
+    {
+        std::move(buffer.begin(), buffer.end(), first);
+    }
+}
+
+template<typename RandomIterator>
+void parallelSort(RandomIterator first, RandomIterator last, size_t grain = 0, WorkQueue* pQueue = nullptr)
+{
+    typedef typename std::iterator_traits<RandomIterator>::value_type value_type;
+    parallelSort(first, last, std::less<value_type>(), grain, pQueue);
+}
+
+} // namespace Foundation
+
+#endif // Foundation_Parallel_h
@@ -0,0 +1,209 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_RingQueue_h
+#define Foundation_RingQueue_h
+
+#include <cstddef>
+#include <atomic>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include "FoundationMacros.h"
+#include "noncopyable.hpp"
+
+namespace Foundation {
+
+/**
+ * Producer/consumer model of a RingQueue.
+ */
+enum class RingQueueMode
+{
+    MPMC,   ///< Multiple producers, multiple consumers.
+    MPSC,   ///< Multiple producers, single consumer.
+    SPSC,   ///< Single producer, single consumer.
+};
+
+/**
+ * A bounded lock-free ring queue.
+ *
+ * Every cell carries a sequence number which tells producers and consumers
+ * whether the cell is free or filled for their lap, so a push or a pop is
+ * one compare-and-swap on the shared position. A side that has a single
+ * thread (the consumer of MPSC, both sides of SPSC) claims its position
+ * with a plain store instead. The producer and consumer positions live on
+ * their own cache lines.
+ *
+ * tryPush fails when the queue is full and tryPop fails when it is empty,
+ * neither ever blocks.
+ */
+template<typename T, RingQueueMode Mode = RingQueueMode::MPMC>
+class RingQueue : noncopyable
+{
+public:
+    /**
+     * @brief Construct a ring queue.
+     * @param[in] capacity  The number of cells, rounded up to a power of two.
+     */
+    explicit RingQueue(size_t capacity)
+        : m_mask(roundUp(capacity) - 1)
+        , m_pCells(new Cell[m_mask + 1])
+    {
+        for (size_t i = 0; i <= m_mask; ++i)
+        {
+            m_pCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_enqueuePos.store(0, std::memory_order_relaxed);
+        m_dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    ~RingQueue()
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        size_t end = m_enqueuePos.load(std::memory_order_relaxed);
+        for (; pos != end; ++pos)
+        {
+            reinterpret_cast<T*>(&m_pCells[pos & m_mask].storage)->~T();
+        }
+        delete [] m_pCells;
+    }
+
+    bool tryPush(const T& value)
+    {
+        Cell* pCell = claim<Mode != RingQueueMode::SPSC>(m_enqueuePos, 0);
+        if (pCell == nullptr)
+        {
+            return false;
+        }
+        size_t pos = pCell->sequence.load(std::memory_order_relaxed);
+        ::new (&pCell->storage) T(value);
+        pCell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPush(T&& value)
+    {
+        Cell* pCell = claim<Mode != RingQueueMode::SPSC>(m_enqueuePos, 0);
+        if (pCell == nullptr)
+        {
+            return false;
+        }
+        size_t pos = pCell->sequence.load(std::memory_order_relaxed);
+        ::new (&pCell->storage) T(std::move(value));
+        pCell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& value)
+    {
+        Cell* pCell = claim<Mode == RingQueueMode::MPMC>(m_dequeuePos, 1);
+        if (pCell == nullptr)
+        {
+            return false;
+        }
+        T* pValue = reinterpret_cast<T*>(&pCell->storage);
+        value = std::move(*pValue);
+        pValue->~T();
+        // pos + 1 + mask: free for the producers of the next lap.
+        size_t pos = pCell->sequence.load(std::memory_order_relaxed) - 1;
+        pCell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Whether the queue looked empty, exact only for the consumer
+     *        of a single consumer queue.
+     */
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /**
+     * @brief The approximate number of queued elements.
+     */
+    size_t size() const
+    {
+        size_t enqueuePos = m_enqueuePos.load(std::memory_order_acquire);
+        size_t dequeuePos = m_dequeuePos.load(std::memory_order_acquire);
+        return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+    }
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t>                                       sequence;
+        typename std::aligned_storage<sizeof(T),
+            std::alignment_of<T>::value>::type                    storage;
+    };
+
+    /**
+     * Claim the cell at position, a cell is ready for producers when its
+     * sequence equals the position and for consumers when it equals
+     * position + 1. Shared positions are claimed with a CAS loop.
+     */
+    template<bool Shared>
+    Cell* claim(std::atomic<size_t>& position, size_t offset)
+    {
+        size_t pos = position.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell* pCell = &m_pCells[pos & m_mask];
+            size_t seq = pCell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + offset);
+            if (diff == 0)
+            {
+                if (!Shared)
+                {
+                    position.store(pos + 1, std::memory_order_relaxed);
+                    return pCell;
+                }
+                if (position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    return pCell;
+                }
+            }
+            else if (diff < 0)
+            {
+                return nullptr;
+            }
+            else
+            {
+                pos = position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    static size_t roundUp(size_t capacity)
+    {
+        size_t result = 2;
+        while (result < capacity)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+private:
+    char                      m_pad0[FOUNDATION_CACHELINE_SIZE];
+    const size_t              m_mask;
+    Cell* const               m_pCells;
+    char                      m_pad1[FOUNDATION_CACHELINE_SIZE - sizeof(size_t) - sizeof(Cell*)];
+    std::atomic<size_t>       m_enqueuePos;
+    char                      m_pad2[FOUNDATION_CACHELINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t>       m_dequeuePos;
+    char                      m_pad3[FOUNDATION_CACHELINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+} // namespace Foundation
+
+#endif // Foundation_RingQueue_h
@@ -0,0 +1,90 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include "FoundationMacros.h"
+#include "Strand.h"
+
+namespace Foundation {
+
+// The strand whose call the current thread is running.
+static FOUNDATION_THREAD_LOCAL const Strand* s_currentStrand = nullptr;
+
+Strand::Strand( WorkQueue* pQueue, const TaskOptions& options )
+    : m_pQueue(pQueue != nullptr ? pQueue : WorkQueue::getInstance())
+    , m_options(options)
+    , m_incoming(nullptr)
+    , m_pending(nullptr)
+    , m_count(0)
+{
+}
+
+bool Strand::runningInThisThread() const
+{
+    return s_currentStrand == this;
+}
+
+void Strand::push( Node* pNode )
+{
+    Node* pHead = m_incoming.load(std::memory_order_relaxed);
+    do
+    {
+        pNode->next = pHead;
+    } while (!m_incoming.compare_exchange_weak(pHead, pNode, std::memory_order_release, std::memory_order_relaxed));
+
+    // The call that makes the strand non-empty schedules the drain.
+    if (m_count.fetch_add(1, std::memory_order_acq_rel) == 0)
+    {
+        schedule();
+    }
+}
+
+void Strand::schedule()
+{
+    pointer self = shared_from_this();
+    m_pQueue->post([self]{ self->drain(); }, m_options);
+}
+
+void Strand::drain()
+{
+    const Strand* pPrevious = s_currentStrand;
+    s_currentStrand = this;
+
+    for (size_t i = 0; i < BATCH_SIZE; ++i)
+    {
+        if (m_pending == nullptr)
+        {
+            // Take everything pushed so far and restore the posting order.
+            Node* pNode = m_incoming.exchange(nullptr, std::memory_order_acquire);
+            while (pNode != nullptr)
+            {
+                Node* pNext = pNode->next;
+                pNode->next = m_pending;
+                m_pending = pNode;
+                pNode = pNext;
+            }
+        }
+
+        // The count is raised after the push, so a counted call is always
+        // in one of the lists.
+        Node* pNode = m_pending;
+        m_pending = pNode->next;
+        (*pNode)();
+        delete pNode;
+
+        if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            s_currentStrand = pPrevious;
+            return;
+        }
+    }
+
+    // Let the other works of the lane run before the rest of the batch.
+    s_currentStrand = pPrevious;
+    schedule();
+}
+
+} // namespace Foundation
@@ -0,0 +1,122 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_Strand_h
+#define Foundation_Strand_h
+
+#include <cstddef>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "noncopyable.hpp"
+#include "Task.h"
+#include "WorkQueue.h"
+
+namespace Foundation {
+
+/**
+ * A serial queue on top of WorkQueue.
+ *
+ * Calls posted to a strand run one at a time in the order they were
+ * posted, on whatever pool thread is free, so state owned by the strand
+ * (a connection, a player) needs no lock. Producers push onto a lock-free
+ * list; the first call posted to an empty strand schedules one drain on
+ * the WorkQueue, which runs up to BATCH_SIZE calls and schedules itself
+ * again if more are left, so a busy strand does not starve the others.
+ * No lock is held while a call runs, and an idle strand costs a few
+ * pointers, so thousands of them can share one pool.
+ *
+ *     Strand::pointer strand = Strand::create();
+ *     strand->post([=]{ player->addScore(10); });
+ *     strand->post([=]{ player->save(); });      // runs after addScore
+ */
+class Strand : public std::enable_shared_from_this<Strand>, noncopyable
+{
+public:
+    typedef std::shared_ptr<Strand> pointer;
+
+    enum { BATCH_SIZE = 32 };
+
+    /**
+     * @brief Create a strand.
+     * @param[in] pQueue   The queue the calls run on, the shared WorkQueue if null.
+     * @param[in] options  Priority lane and node the strand is scheduled with.
+     */
+    static pointer create(WorkQueue* pQueue = nullptr, const TaskOptions& options = TaskOptions())
+    {
+        return pointer(new Strand(pQueue, options));
+    }
+
+    /**
+     * @brief Queue a callable behind the calls posted before it.
+     *        The callable must not throw. Pending calls keep the strand alive.
+     */
+    template<typename F>
+    void post(F&& f)
+    {
+        push(new Node(std::forward<F>(f)));
+    }
+
+    /**
+     * @brief Queue a callable behind the calls posted before it.
+     * @return A future holding the result or the exception of the call.
+     */
+    template<typename F>
+    std::future<typename detail::ResultOf<F>::type> submit(F&& f)
+    {
+        typedef typename std::decay<F>::type          functor_type;
+        typedef typename detail::ResultOf<F>::type    result_type;
+
+        std::promise<result_type> promise(std::allocator_arg, PoolAllocator<char>());
+        std::future<result_type> future = promise.get_future();
+        post(detail::PromiseCall<result_type, functor_type>(std::move(promise), functor_type(std::forward<F>(f))));
+        return future;
+    }
+
+    /**
+     * @brief Whether the calling thread is running a call of this strand.
+     */
+    bool runningInThisThread() const;
+
+    /**
+     * @brief Get the number of calls posted and not finished yet.
+     */
+    size_t size() const { return m_count.load(std::memory_order_relaxed); }
+
+private:
+    struct Node : public Task
+    {
+        template<typename F>
+        explicit Node(F&& f) : Task(std::forward<F>(f)), next(nullptr) {}
+
+        Node* next;
+    };
+
+    Strand(WorkQueue* pQueue, const TaskOptions& options);
+
+    void push(Node* pNode);
+
+    void schedule();
+
+    /**
+     * Runs on a pool thread, at most one drain of a strand is queued or
+     * running at any time.
+     */
+    void drain();
+
+    WorkQueue*                 m_pQueue;
+    TaskOptions                m_options;
+    std::atomic<Node*>         m_incoming;  ///< pushed by producers, newest first
+    Node*                      m_pending;   ///< owned by the drain, oldest first
+    std::atomic<size_t>        m_count;     ///< calls posted and not finished
+};
+
+} // namespace Foundation
+
+#endif // Foundation_Strand_h
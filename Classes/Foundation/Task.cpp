@@ -0,0 +1,195 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "FoundationMacros.h"
+#include "Task.h"
+
+namespace Foundation {
+
+namespace {
+
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+// Per thread free lists, one for every size class.
+FOUNDATION_THREAD_LOCAL FreeBlock*  s_freeLists[TaskPool::ClassCount];
+FOUNDATION_THREAD_LOCAL std::size_t s_freeCounts[TaskPool::ClassCount];
+
+// Set once the thread has armed s_cacheGuard.
+FOUNDATION_THREAD_LOCAL bool        s_cacheGuarded;
+
+// Batches of BatchSize blocks shared by all threads.
+std::mutex                          s_depotMutex;
+std::vector<FreeBlock*>             s_depot[TaskPool::ClassCount];
+
+// The batches in every depot list, read without the lock.
+std::atomic<std::size_t>            s_depotCounts[TaskPool::ClassCount];
+
+inline int sizeClass(std::size_t size)
+{
+    int index = 0;
+    std::size_t blockSize = TaskPool::MinBlockSize;
+    while (blockSize < size)
+    {
+        blockSize <<= 1;
+        ++index;
+    }
+    return index;
+}
+
+inline std::size_t classSize(int index)
+{
+    return std::size_t(TaskPool::MinBlockSize) << index;
+}
+
+// Detach BatchSize blocks from the thread list and chain them together.
+FreeBlock* takeBatch(int index)
+{
+    FreeBlock* head = s_freeLists[index];
+    FreeBlock* tail = head;
+    for (int i = 1; i < TaskPool::BatchSize; ++i)
+    {
+        tail = tail->next;
+    }
+    s_freeLists[index] = tail->next;
+    s_freeCounts[index] -= TaskPool::BatchSize;
+    tail->next = nullptr;
+    return head;
+}
+
+#if !defined(_MSC_VER) || _MSC_VER >= 1900
+// Hands the cache of every thread back when the thread exits, not only the
+// cache of the WorkQueue workers. __declspec(thread) can't hold an object
+// with a destructor, on older compilers only the workers release theirs.
+struct ThreadCacheGuard
+{
+    ~ThreadCacheGuard()
+    {
+        TaskPool::releaseThreadCache();
+    }
+
+    void arm() {}
+};
+
+thread_local ThreadCacheGuard       s_cacheGuard;
+#endif
+
+// Called when the thread starts caching blocks.
+inline void guardThreadCache()
+{
+    if (!s_cacheGuarded)
+    {
+        s_cacheGuarded = true;
+#if !defined(_MSC_VER) || _MSC_VER >= 1900
+        s_cacheGuard.arm();
+#endif
+    }
+}
+
+} // namespace
+
+void* TaskPool::allocate(std::size_t size)
+{
+    if (size > MaxBlockSize)
+    {
+        return ::operator new(size);
+    }
+
+    int index = sizeClass(size);
+    if (s_freeLists[index] == nullptr)
+    {
+        guardThreadCache();
+        // Producers that never free would find the depot dry every time,
+        // only lock it when it has a batch.
+        if (s_depotCounts[index].load(std::memory_order_relaxed) != 0)
+        {
+            std::lock_guard<std::mutex> lock(s_depotMutex);
+            if (!s_depot[index].empty())
+            {
+                s_freeLists[index] = s_depot[index].back();
+                s_freeCounts[index] = BatchSize;
+                s_depot[index].pop_back();
+                s_depotCounts[index].store(s_depot[index].size(), std::memory_order_relaxed);
+            }
+        }
+
+        // Still empty, take a whole batch from the heap.
+        if (s_freeLists[index] == nullptr)
+        {
+            for (int i = 0; i < BatchSize; ++i)
+            {
+                FreeBlock* block = static_cast<FreeBlock*>(::operator new(classSize(index)));
+                block->next = s_freeLists[index];
+                s_freeLists[index] = block;
+                ++s_freeCounts[index];
+            }
+        }
+    }
+
+    FreeBlock* block = s_freeLists[index];
+    s_freeLists[index] = block->next;
+    --s_freeCounts[index];
+    return block;
+}
+
+void TaskPool::deallocate(void* p, std::size_t size)
+{
+    if (p == nullptr)
+    {
+        return;
+    }
+    if (size > MaxBlockSize)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    guardThreadCache();
+    int index = sizeClass(size);
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    block->next = s_freeLists[index];
+    s_freeLists[index] = block;
+
+    if (++s_freeCounts[index] >= 2 * BatchSize)
+    {
+        FreeBlock* batch = takeBatch(index);
+        std::lock_guard<std::mutex> lock(s_depotMutex);
+        s_depot[index].push_back(batch);
+        s_depotCounts[index].store(s_depot[index].size(), std::memory_order_relaxed);
+    }
+}
+
+void TaskPool::releaseThreadCache()
+{
+    for (int index = 0; index < ClassCount; ++index)
+    {
+        while (s_freeCounts[index] >= BatchSize)
+        {
+            FreeBlock* batch = takeBatch(index);
+            std::lock_guard<std::mutex> lock(s_depotMutex);
+            s_depot[index].push_back(batch);
+            s_depotCounts[index].store(s_depot[index].size(), std::memory_order_relaxed);
+        }
+
+        FreeBlock* block = s_freeLists[index];
+        while (block != nullptr)
+        {
+            FreeBlock* next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+        s_freeLists[index] = nullptr;
+        s_freeCounts[index] = 0;
+    }
+}
+
+} // namespace Foundation
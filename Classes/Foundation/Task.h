@@ -0,0 +1,341 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_Task_h
+#define Foundation_Task_h
+
+#include <cstddef>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include "FoundationMacros.h"
+#include "noncopyable.hpp"
+
+namespace Foundation {
+
+namespace detail {
+
+/**
+ * The type returned by calling F with Args, as ResultOf<F, Args...>::type.
+ * Like the standard traits it has no type when the call is ill-formed.
+ */
+template<typename F, typename... Args>
+struct ResultOf
+#if FOUNDATION_HAS_INVOKE_RESULT
+    : std::invoke_result<F, Args...>
+#else
+    : std::result_of<F(Args...)>
+#endif
+{
+};
+
+} // namespace detail
+
+/**
+ * Small block allocator used for task storage.
+ *
+ * Blocks up to MaxBlockSize bytes are kept in per-thread free lists, one
+ * list for every size class, so a worker reuses the slots of the tasks it
+ * has run without touching the heap. Lists that grow too long hand a batch
+ * of blocks over to a shared depot, threads with an empty list take a batch
+ * back from it, or a new batch from operator new when the depot is empty.
+ * Larger blocks go straight to operator new.
+ */
+class TaskPool
+{
+public:
+    enum
+    {
+        MinBlockSize = 32,
+        MaxBlockSize = 4096,
+        ClassCount   = 8,   ///< 32, 64, ..., 4096, large enough for coroutine frames
+        BatchSize    = 64   ///< Blocks moved between a thread and the depot at once.
+    };
+
+    static void* allocate(std::size_t size);
+
+    static void  deallocate(void* p, std::size_t size);
+
+    /**
+     * @brief Return the blocks cached by the calling thread to the depot.
+     *        Runs by itself when a thread exits, worker threads also call
+     *        it before they exit.
+     */
+    static void  releaseThreadCache();
+};
+
+/**
+ * Standard allocator on top of TaskPool, used for the shared state of the
+ * futures returned by WorkQueue::submit.
+ */
+template<typename T>
+class PoolAllocator
+{
+public:
+    typedef T              value_type;
+    typedef T*             pointer;
+    typedef const T*       const_pointer;
+    typedef T&             reference;
+    typedef const T&       const_reference;
+    typedef std::size_t    size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template<typename U>
+    struct rebind { typedef PoolAllocator<U> other; };
+
+    PoolAllocator() {}
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(TaskPool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        TaskPool::deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const { return true; }
+
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+/**
+ * Priority lanes of WorkQueue, HIGH is served first.
+ */
+enum class TaskPriority
+{
+    HIGH,
+    NORMAL,
+    LOW,
+};
+
+static const std::size_t TASK_PRIORITY_COUNT = 3;
+
+/**
+ * Scheduling options of a task.
+ */
+struct TaskOptions
+{
+    typedef std::chrono::steady_clock clock_type;
+
+    static const std::size_t ANY_NODE = static_cast<std::size_t>(-1);
+
+    TaskPriority           priority;
+
+    /** Tasks with a deadline run earliest-deadline-first inside their lane,
+        ahead of the tasks without one. */
+    clock_type::time_point deadline;
+
+    /** The NUMA node the task should run on, see CpuTopology. Only a hint,
+        honoured when the WorkQueue places its workers by node. */
+    std::size_t            node;
+
+    TaskOptions(TaskPriority p = TaskPriority::NORMAL)
+        : priority(p)
+        , deadline(clock_type::time_point::max())
+        , node(ANY_NODE)
+    {
+    }
+
+    TaskOptions(TaskPriority p, clock_type::time_point d)
+        : priority(p)
+        , deadline(d)
+        , node(ANY_NODE)
+    {
+    }
+
+    bool hasDeadline() const { return deadline != clock_type::time_point::max(); }
+};
+
+/**
+ * A type-erased, move-only callable.
+ *
+ * Callables up to InlineSize bytes are stored inside the task itself,
+ * the task object is allocated from TaskPool.
+ */
+class Task : noncopyable
+{
+public:
+    enum { InlineSize = 64 };
+
+    template<typename F>
+    explicit Task(F&& f)
+        : m_reusable(false)
+    {
+        typedef typename std::decay<F>::type functor_type;
+        construct<functor_type>(std::forward<F>(f),
+            std::integral_constant<bool, (sizeof(functor_type) <= InlineSize
+                && std::alignment_of<functor_type>::value <= std::alignment_of<storage_type>::value)>());
+    }
+
+    ~Task()
+    {
+        m_destroy(m_pCallable);
+    }
+
+    /**
+     * @brief Run the stored callable.
+     */
+    void operator()()
+    {
+        m_invoke(m_pCallable);
+    }
+
+    const TaskOptions& getOptions() const { return m_options; }
+
+    void setOptions(const TaskOptions& options) { m_options = options; }
+
+    /**
+     * @brief The time the task was queued, set by WorkQueue.
+     */
+    TaskOptions::clock_type::time_point getEnqueueTime() const { return m_enqueueTime; }
+
+    void setEnqueueTime(TaskOptions::clock_type::time_point time) { m_enqueueTime = time; }
+
+    /**
+     * @brief A reusable task is not destroyed by the WorkQueue after it ran,
+     *        its owner may queue it again. Such a task lives in its owner,
+     *        not in TaskPool, see WorkQueue::addWork(Task&).
+     */
+    bool isReusable() const { return m_reusable; }
+
+    void setReusable(bool bReusable) { m_reusable = bReusable; }
+
+    static void* operator new(std::size_t size)
+    {
+        return TaskPool::allocate(size);
+    }
+
+    static void operator delete(void* p, std::size_t size)
+    {
+        TaskPool::deallocate(p, size);
+    }
+
+private:
+    typedef void (*invoke_type)(void*);
+    typedef void (*destroy_type)(void*);
+    typedef std::aligned_storage<InlineSize>::type storage_type;
+
+    template<typename F, typename A>
+    void construct(A&& f, std::true_type)
+    {
+        m_pCallable = ::new (&m_storage) F(std::forward<A>(f));
+        m_invoke    = &Task::invoke<F>;
+        m_destroy   = &Task::destroyInline<F>;
+    }
+
+    template<typename F, typename A>
+    void construct(A&& f, std::false_type)
+    {
+        void* p = TaskPool::allocate(sizeof(F));
+        try
+        {
+            m_pCallable = ::new (p) F(std::forward<A>(f));
+        }
+        catch (...)
+        {
+            TaskPool::deallocate(p, sizeof(F));
+            throw;
+        }
+        m_invoke    = &Task::invoke<F>;
+        m_destroy   = &Task::destroyAllocated<F>;
+    }
+
+    template<typename F>
+    static void invoke(void* p)
+    {
+        (*static_cast<F*>(p))();
+    }
+
+    template<typename F>
+    static void destroyInline(void* p)
+    {
+        static_cast<F*>(p)->~F();
+    }
+
+    template<typename F>
+    static void destroyAllocated(void* p)
+    {
+        static_cast<F*>(p)->~F();
+        TaskPool::deallocate(p, sizeof(F));
+    }
+
+private:
+    void*                                m_pCallable;
+    invoke_type                          m_invoke;
+    destroy_type                         m_destroy;
+    TaskOptions                          m_options;
+    TaskOptions::clock_type::time_point  m_enqueueTime;
+    bool                                 m_reusable;
+    storage_type                         m_storage;
+};
+
+namespace detail {
+
+/**
+ * Runs a bound call and fulfils the promise of a submit, used by
+ * WorkQueue and Strand.
+ */
+template<typename R, typename F>
+struct PromiseCall
+{
+    std::promise<R> promise;
+    F               call;
+
+    PromiseCall(std::promise<R>&& p, F&& f) : promise(std::move(p)), call(std::move(f)) {}
+    PromiseCall(PromiseCall&& other) : promise(std::move(other.promise)), call(std::move(other.call)) {}
+
+    void operator()()
+    {
+        try
+        {
+            promise.set_value(call());
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    }
+};
+
+template<typename F>
+struct PromiseCall<void, F>
+{
+    std::promise<void> promise;
+    F                  call;
+
+    PromiseCall(std::promise<void>&& p, F&& f) : promise(std::move(p)), call(std::move(f)) {}
+    PromiseCall(PromiseCall&& other) : promise(std::move(other.promise)), call(std::move(other.call)) {}
+
+    void operator()()
+    {
+        try
+        {
+            call();
+            promise.set_value();
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    }
+};
+
+} // namespace detail
+
+} // namespace Foundation
+
+#endif // Foundation_Task_h
@@ -0,0 +1,226 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include "Exception.h"
+#include "WorkQueue.h"
+#include "TaskGraph.h"
+
+namespace Foundation {
+
+TaskGraph::Node::Node(TaskGraph* pGraph, NodeId nId, std::function<void()>&& work)
+    : task([this]{ graph->execute(this); })
+    , graph(pGraph)
+    , id(nId)
+    , work(std::move(work))
+    , predecessorCount(0)
+    , pendingCount(0)
+{
+    task.setReusable(true);
+}
+
+TaskGraph::TaskGraph(WorkQueue* pQueue)
+    : m_pQueue(pQueue != nullptr ? pQueue : WorkQueue::getInstance())
+    , m_validated(true)
+    , m_remaining(0)
+    , m_failed(false)
+    , m_finishedFlag(true)
+    , m_scheduled(0)
+    , m_waiting(false)
+{
+}
+
+TaskGraph::~TaskGraph()
+{
+}
+
+TaskGraph::NodeId TaskGraph::addTask(std::function<void()> work)
+{
+    m_nodes.push_back(std::unique_ptr<Node>(new Node(this, m_nodes.size(), std::move(work))));
+    m_validated = false;
+    return m_nodes.size() - 1;
+}
+
+TaskGraph::NodeId TaskGraph::addTask(std::function<void()> work, const std::vector<NodeId>& predecessors)
+{
+    NodeId node = addTask(std::move(work));
+    for (size_t i = 0; i < predecessors.size(); ++i)
+    {
+        addDependency(node, predecessors[i]);
+    }
+    return node;
+}
+
+void TaskGraph::addDependency(NodeId node, NodeId predecessor)
+{
+    if (node >= m_nodes.size() || predecessor >= m_nodes.size())
+    {
+        throw InvalidArgumentException("TaskGraph node id out of range");
+    }
+    m_nodes[predecessor]->successors.push_back(m_nodes[node].get());
+    ++m_nodes[node]->predecessorCount;
+    m_validated = false;
+}
+
+void TaskGraph::run()
+{
+    if (m_nodes.empty())
+    {
+        return;
+    }
+    validate();
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        m_nodes[i]->pendingCount = m_nodes[i]->predecessorCount;
+    }
+    m_remaining = m_nodes.size();
+    m_failed = false;
+    m_error = nullptr;
+    m_finishedFlag = false;
+
+    for (size_t i = 0; i < m_roots.size(); ++i)
+    {
+        m_pQueue->addWork(m_roots[i]->task);
+    }
+
+    // Help with the queued works until the graph is done. Wait for the flag
+    // rather than the count: the last task still holds the lock when it is
+    // set, so the graph outlives its notification.
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_finishedFlag)
+    {
+        size_t nScheduled = m_scheduled;
+        lock.unlock();
+        bool bRan = m_pQueue->tryRunWork();
+        lock.lock();
+        if (bRan || m_finishedFlag)
+        {
+            continue;
+        }
+
+        // Sleep until a task queues a node or the graph finishes. A node
+        // queued before m_waiting was set has changed m_scheduled.
+        m_waiting = true;
+        if (m_scheduled == nScheduled)
+        {
+            m_finished.wait(lock);
+        }
+        m_waiting = false;
+    }
+    if (m_error)
+    {
+        std::rethrow_exception(m_error);
+    }
+}
+
+void TaskGraph::execute(Node* pNode)
+{
+    while (pNode != nullptr)
+    {
+        if (!m_failed)
+        {
+            try
+            {
+                pNode->work();
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+        }
+
+        // Queue the successors that became ready, keep the last one.
+        Node* pNext = nullptr;
+        for (size_t i = 0; i < pNode->successors.size(); ++i)
+        {
+            Node* pSuccessor = pNode->successors[i];
+            if (--pSuccessor->pendingCount == 0)
+            {
+                if (pNext != nullptr)
+                {
+                    schedule(pNext);
+                }
+                pNext = pSuccessor;
+            }
+        }
+
+        if (--m_remaining == 0)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_finishedFlag = true;
+            m_finished.notify_all();
+        }
+        pNode = pNext;
+    }
+}
+
+void TaskGraph::schedule(Node* pNode)
+{
+    m_pQueue->addWork(pNode->task);
+    ++m_scheduled;
+    if (m_waiting)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_finished.notify_all();
+    }
+}
+
+void TaskGraph::fail(std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_error)
+    {
+        m_error = error;
+    }
+    m_failed = true;
+}
+
+void TaskGraph::validate()
+{
+    if (m_validated)
+    {
+        return;
+    }
+
+    // Kahn's algorithm, every node must be reachable from the roots.
+    std::vector<size_t> pending(m_nodes.size());
+    std::vector<Node*> ready;
+    m_roots.clear();
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        pending[i] = m_nodes[i]->predecessorCount;
+        if (pending[i] == 0)
+        {
+            m_roots.push_back(m_nodes[i].get());
+            ready.push_back(m_nodes[i].get());
+        }
+    }
+
+    size_t visited = 0;
+    while (!ready.empty())
+    {
+        Node* pNode = ready.back();
+        ready.pop_back();
+        ++visited;
+        for (size_t i = 0; i < pNode->successors.size(); ++i)
+        {
+            Node* pSuccessor = pNode->successors[i];
+            if (--pending[pSuccessor->id] == 0)
+            {
+                ready.push_back(pSuccessor);
+            }
+        }
+    }
+
+    if (visited != m_nodes.size())
+    {
+        throw CircularReferenceException("TaskGraph has a cycle");
+    }
+    m_validated = true;
+}
+
+} // namespace Foundation
@@ -0,0 +1,133 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_TaskGraph_h
+#define Foundation_TaskGraph_h
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "noncopyable.hpp"
+#include "Task.h"
+
+namespace Foundation {
+
+class WorkQueue;
+
+/**
+ * A graph of tasks run on a WorkQueue.
+ *
+ * Every task declares the tasks it depends on. When the graph runs, each
+ * node keeps an atomic count of its unfinished predecessors; a finishing
+ * task decrements the counts of its successors and queues the ones that
+ * became ready, the last ready successor runs inline on the same thread.
+ * There is no barrier between stages, a task starts as soon as its own
+ * inputs are done.
+ *
+ * The graph can be run again and again, a run does not allocate: every
+ * node carries the reusable task it is queued with. A graph must not be
+ * changed or run twice at the same time.
+ */
+class TaskGraph : noncopyable
+{
+public:
+    typedef size_t NodeId;
+
+    /**
+     * @brief Construct an empty graph.
+     * @param[in] pQueue  The queue to run on, the shared WorkQueue by default.
+     */
+    explicit TaskGraph(WorkQueue* pQueue = nullptr);
+    ~TaskGraph();
+
+    /**
+     * @brief Add a task to the graph.
+     * @param[in] work  The work of the task.
+     * @return The id of the task, used to declare dependencies.
+     */
+    NodeId addTask(std::function<void()> work);
+
+    /**
+     * @brief Add a task that runs after all of its predecessors.
+     * @param[in] work          The work of the task.
+     * @param[in] predecessors  The tasks which must finish first.
+     * @return The id of the task.
+     */
+    NodeId addTask(std::function<void()> work, const std::vector<NodeId>& predecessors);
+
+    /**
+     * @brief Declare that node runs after predecessor.
+     */
+    void addDependency(NodeId node, NodeId predecessor);
+
+    /**
+     * @brief Run the whole graph and wait for it. The calling thread runs
+     *        queued works while it waits, so a graph may be run from a task
+     *        of its own queue. When a task throws, the tasks not started
+     *        yet are skipped and the first exception is rethrown here.
+     */
+    void run();
+
+    size_t size() const { return m_nodes.size(); }
+
+private:
+    /**
+     * A task of the graph. Its queue task is reused by every run.
+     */
+    class Node : noncopyable
+    {
+    public:
+        Node(TaskGraph* pGraph, NodeId nId, std::function<void()>&& work);
+
+        Task                    task;
+        TaskGraph*              graph;
+        NodeId                  id;
+        std::function<void()>   work;
+        std::vector<Node*>      successors;
+        size_t                  predecessorCount;
+        std::atomic<size_t>     pendingCount;
+    };
+
+    /**
+     * @brief Run a node and the chain of successors it makes ready.
+     */
+    void execute(Node* pNode);
+
+    /**
+     * @brief Queue a ready node, waking run() if it waits for one.
+     */
+    void schedule(Node* pNode);
+
+    void fail(std::exception_ptr error);
+
+    /**
+     * @brief Throw CircularReferenceException if the graph has a cycle.
+     */
+    void validate();
+
+private:
+    WorkQueue*                             m_pQueue;
+    std::vector<std::unique_ptr<Node> >    m_nodes;
+    std::vector<Node*>                     m_roots;
+    bool                                   m_validated;
+    std::atomic<size_t>                    m_remaining;
+    std::atomic<bool>                      m_failed;
+    std::exception_ptr                     m_error;
+    bool                                   m_finishedFlag;  ///< guarded by m_lock
+    std::atomic<size_t>                    m_scheduled;     ///< nodes queued by tasks so far
+    std::atomic<bool>                      m_waiting;       ///< run() found nothing to help with
+    std::mutex                             m_lock;
+    std::condition_variable                m_finished;
+};
+
+} // namespace Foundation
+
+#endif // Foundation_TaskGraph_h
@@ -0,0 +1,381 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include <algorithm>
+#include <limits>
+#include "WorkQueue.h"
+#include "TimerWheel.h"
+
+namespace Foundation {
+
+TimerWheel::TimerWheel()
+    : m_pQueue(nullptr)
+    , m_tick(1)
+{
+    init();
+}
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, WorkQueue* pQueue)
+    : m_pQueue(pQueue)
+    , m_tick(tick.count() > 0 ? tick : std::chrono::milliseconds(1))
+{
+    init();
+}
+
+TimerWheel::~TimerWheel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_quit = true;
+    }
+    m_wakeup.notify_one();
+    m_thread.join();
+}
+
+void TimerWheel::init()
+{
+    if (m_pQueue == nullptr)
+    {
+        m_pQueue = WorkQueue::getInstance();
+    }
+    m_start = clock_type::now();
+    m_currentTick = 0;
+    m_wakeTick = std::numeric_limits<uint64_t>::max();
+    m_freeList = NIL;
+    m_pendingCount = 0;
+    m_quit = false;
+    for (size_t i = 0; i < LEVEL_COUNT * SLOT_COUNT; ++i)
+    {
+        m_buckets[i] = NIL;
+    }
+    m_thread = std::thread(&TimerWheel::runTicker, this);
+}
+
+TimerWheel::TimerId TimerWheel::scheduleAfter(std::chrono::milliseconds delay, std::function<void()> callback,
+                                              const TaskOptions& options)
+{
+    return schedule(delay, 0, std::move(callback), nullptr, options);
+}
+
+TimerWheel::TimerId TimerWheel::scheduleEvery(std::chrono::milliseconds period, std::function<void()> callback,
+                                              const TaskOptions& options)
+{
+    if (period < m_tick)
+    {
+        period = m_tick;
+    }
+    uint64_t nPeriod = static_cast<uint64_t>((period + m_tick - std::chrono::milliseconds(1)) / m_tick);
+    return schedule(period, nPeriod, nullptr,
+        std::make_shared<Periodic>(std::move(callback)), options);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(std::chrono::milliseconds delay, uint64_t period, std::function<void()>&& callback,
+                                         std::shared_ptr<Periodic>&& periodic, const TaskOptions& options)
+{
+    // The first tick boundary at or after now + delay.
+    clock_type::duration due = clock_type::now() - m_start + std::max(delay, std::chrono::milliseconds(0));
+    clock_type::duration tick = m_tick;
+    uint64_t expires = static_cast<uint64_t>((due.count() + tick.count() - 1) / tick.count());
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    uint32_t nIndex = m_freeList;
+    if (nIndex != NIL)
+    {
+        m_freeList = m_timers[nIndex].next;
+    }
+    else
+    {
+        nIndex = static_cast<uint32_t>(m_timers.size());
+        m_timers.push_back(Timer());
+    }
+
+    Timer& timer = m_timers[nIndex];
+    timer.expires  = expires;
+    timer.period   = period;
+    timer.callback = std::move(callback);
+    timer.periodic = std::move(periodic);
+    timer.options  = options;
+    link(nIndex);
+    ++m_pendingCount;
+
+    if (expires < m_wakeTick)
+    {
+        m_wakeup.notify_one();
+    }
+    return (static_cast<TimerId>(timer.generation) << 32) | nIndex;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+    uint32_t nIndex = static_cast<uint32_t>(id & 0xffffffff);
+    uint32_t nGeneration = static_cast<uint32_t>(id >> 32);
+
+    // The callback is destroyed outside the lock, it may cancel other timers.
+    std::function<void()> callback;
+    std::shared_ptr<Periodic> periodic;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (nIndex >= m_timers.size())
+        {
+            return false;
+        }
+        Timer& timer = m_timers[nIndex];
+        if (timer.generation != nGeneration || timer.bucket == NIL)
+        {
+            return false;
+        }
+        unlink(nIndex);
+        callback.swap(timer.callback);
+        periodic.swap(timer.periodic);
+        release(nIndex);
+    }
+    return true;
+}
+
+size_t TimerWheel::size() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_pendingCount;
+}
+
+void TimerWheel::link(uint32_t nIndex)
+{
+    Timer& timer = m_timers[nIndex];
+    uint64_t expires = timer.expires;
+    uint64_t delta = expires > m_currentTick ? expires - m_currentTick : 0;
+
+    size_t nLevel = 0;
+    if (delta == 0)
+    {
+        // Overdue, runs with the next processed tick.
+        expires = m_currentTick;
+    }
+    else
+    {
+        while (nLevel < LEVEL_COUNT - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (nLevel + 1))))
+        {
+            ++nLevel;
+        }
+        // Farther than the wheel reaches: park in the last slot of the top
+        // level, the timer is linked again when that slot is cascaded.
+        uint64_t maxDelta = (uint64_t(1) << (SLOT_BITS * LEVEL_COUNT)) - 1;
+        if (delta > maxDelta)
+        {
+            expires = m_currentTick + maxDelta;
+        }
+    }
+
+    uint32_t nBucket = static_cast<uint32_t>(nLevel * SLOT_COUNT + ((expires >> (SLOT_BITS * nLevel)) & SLOT_MASK));
+    timer.bucket = nBucket;
+    timer.prev = NIL;
+    timer.next = m_buckets[nBucket];
+    if (timer.next != NIL)
+    {
+        m_timers[timer.next].prev = nIndex;
+    }
+    m_buckets[nBucket] = nIndex;
+}
+
+void TimerWheel::unlink(uint32_t nIndex)
+{
+    Timer& timer = m_timers[nIndex];
+    if (timer.prev != NIL)
+    {
+        m_timers[timer.prev].next = timer.next;
+    }
+    else
+    {
+        m_buckets[timer.bucket] = timer.next;
+    }
+    if (timer.next != NIL)
+    {
+        m_timers[timer.next].prev = timer.prev;
+    }
+    timer.prev = NIL;
+    timer.next = NIL;
+    timer.bucket = NIL;
+}
+
+void TimerWheel::release(uint32_t nIndex)
+{
+    Timer& timer = m_timers[nIndex];
+    timer.callback = nullptr;
+    timer.periodic.reset();
+    if (++timer.generation == 0)
+    {
+        timer.generation = 1;
+    }
+    timer.next = m_freeList;
+    m_freeList = nIndex;
+    --m_pendingCount;
+}
+
+size_t TimerWheel::cascade(size_t nLevel)
+{
+    size_t nSlot = static_cast<size_t>((m_currentTick >> (SLOT_BITS * nLevel)) & SLOT_MASK);
+    uint32_t& head = m_buckets[nLevel * SLOT_COUNT + nSlot];
+    uint32_t nIndex = head;
+    head = NIL;
+    while (nIndex != NIL)
+    {
+        uint32_t nNext = m_timers[nIndex].next;
+        link(nIndex);
+        nIndex = nNext;
+    }
+    return nSlot;
+}
+
+void TimerWheel::advance()
+{
+    size_t nSlot = static_cast<size_t>(m_currentTick & SLOT_MASK);
+    if (nSlot == 0)
+    {
+        // The lowest level wrapped, pull the next slot of each level down.
+        for (size_t nLevel = 1; nLevel < LEVEL_COUNT && cascade(nLevel) == 0; ++nLevel)
+        {
+        }
+    }
+
+    uint32_t nIndex = m_buckets[nSlot];
+    m_buckets[nSlot] = NIL;
+    while (nIndex != NIL)
+    {
+        Timer& timer = m_timers[nIndex];
+        uint32_t nNext = timer.next;
+        timer.bucket = NIL;
+
+        m_expired.push_back(Expired());
+        Expired& expired = m_expired.back();
+        expired.options = timer.options;
+        if (timer.period != 0)
+        {
+            // Fixed rate, ticks missed while the wheel lagged are dropped.
+            expired.periodic = timer.periodic;
+            timer.expires += timer.period;
+            if (timer.expires <= m_currentTick)
+            {
+                timer.expires = m_currentTick + 1;
+            }
+            link(nIndex);
+        }
+        else
+        {
+            expired.callback = std::move(timer.callback);
+            release(nIndex);
+        }
+        nIndex = nNext;
+    }
+    ++m_currentTick;
+}
+
+uint64_t TimerWheel::nextWakeTick() const
+{
+    uint64_t wake = std::numeric_limits<uint64_t>::max();
+    if (m_pendingCount == 0)
+    {
+        return wake;
+    }
+    // A slot of level 0 runs at its tick, a slot of a higher level is
+    // cascaded at the first tick of its span. Every level holds the spans
+    // of one lap from the current tick on, so the first occupied slot of
+    // that lap is the next one to process.
+    for (size_t nLevel = 0; nLevel < LEVEL_COUNT; ++nLevel)
+    {
+        size_t nShift = SLOT_BITS * nLevel;
+        uint64_t span = (m_currentTick + (uint64_t(1) << nShift) - 1) >> nShift;
+        for (size_t i = 0; i < SLOT_COUNT; ++i, ++span)
+        {
+            if (m_buckets[nLevel * SLOT_COUNT + (span & SLOT_MASK)] != NIL)
+            {
+                wake = std::min(wake, span << nShift);
+                break;
+            }
+        }
+    }
+    return wake;
+}
+
+uint64_t TimerWheel::nowTick() const
+{
+    return static_cast<uint64_t>((clock_type::now() - m_start) / m_tick);
+}
+
+void TimerWheel::dispatch(Expired& expired)
+{
+    if (expired.periodic)
+    {
+        if (expired.periodic->running.exchange(true))
+        {
+            // The previous run is still busy.
+            return;
+        }
+        std::shared_ptr<Periodic> periodic(std::move(expired.periodic));
+        m_pQueue->post([periodic]
+        {
+            periodic->callback();
+            periodic->running = false;
+        }, expired.options);
+    }
+    else
+    {
+        m_pQueue->post(std::move(expired.callback), expired.options);
+    }
+}
+
+void TimerWheel::runTicker()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (true)
+    {
+        // Jump over the ticks that neither run nor cascade a timer, so
+        // catching up after an idle period costs the occupied slots, not
+        // the elapsed ticks.
+        uint64_t now = nowTick();
+        while (m_currentTick <= now)
+        {
+            uint64_t next = nextWakeTick();
+            if (next > m_currentTick)
+            {
+                m_currentTick = std::min(next, now + 1);
+                continue;
+            }
+            advance();
+        }
+
+        if (!m_expired.empty())
+        {
+            // Hand the callbacks over without holding the lock, so that
+            // scheduling and cancelling are not held up by the WorkQueue.
+            m_wakeTick = 0;
+            lock.unlock();
+            for (size_t i = 0; i < m_expired.size(); ++i)
+            {
+                dispatch(m_expired[i]);
+            }
+            m_expired.clear();
+            lock.lock();
+            continue;
+        }
+
+        if (m_quit)
+        {
+            break;
+        }
+
+        m_wakeTick = nextWakeTick();
+        if (m_wakeTick == std::numeric_limits<uint64_t>::max())
+        {
+            m_wakeup.wait(lock);
+        }
+        else
+        {
+            m_wakeup.wait_until(lock, m_start + m_tick * static_cast<long long>(m_wakeTick));
+        }
+    }
+}
+
+} // namespace Foundation
@@ -0,0 +1,212 @@
+/****************************************************************************
+  Copyright (c) 2014-2015 libo.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_TimerWheel_h
+#define Foundation_TimerWheel_h
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Singleton.h"
+#include "Task.h"
+
+namespace Foundation {
+
+class WorkQueue;
+
+/**
+ * A hierarchical timing wheel for delayed and periodic work.
+ *
+ * Time is cut into ticks. The wheel has LEVEL_COUNT levels of SLOT_COUNT
+ * slots, a slot of level n spans SLOT_COUNT^n ticks. A timer is linked
+ * into the slot of the lowest level that covers its delay; whenever the
+ * lowest level wraps around, the next slot of the level above is spread
+ * over the levels below. Scheduling and cancelling are O(1), however many
+ * timers are pending.
+ *
+ * One tick thread drives the wheel and hands expired callbacks to a
+ * WorkQueue, so thousands of timers share a single thread and no callback
+ * ever runs on the tick thread itself. The tick thread sleeps until the
+ * next slot that holds a timer, an idle wheel does not wake up at all.
+ *
+ * Timers are named by a TimerId carrying the index and the generation of
+ * their slot. A slot's generation changes when it is freed, so cancelling
+ * a timer that has already fired, or whose slot was reused, does nothing.
+ */
+class TimerWheel : public Singleton<TimerWheel>
+{
+public:
+    typedef std::chrono::steady_clock clock_type;
+    typedef uint64_t                  TimerId;
+
+    static const TimerId INVALID_TIMER = 0;
+
+    /**
+     * @brief Construct a wheel with its own tick thread.
+     * @param[in] tick    The resolution of the wheel, delays are rounded up to it.
+     * @param[in] pQueue  The queue the callbacks run on, the shared WorkQueue by default.
+     */
+    TimerWheel(std::chrono::milliseconds tick, WorkQueue* pQueue = nullptr);
+
+    ~TimerWheel();
+
+    /**
+     * @brief Run a callback once after a delay.
+     * @param[in] delay     The time to wait.
+     * @param[in] callback  The callback, run on the WorkQueue. It must not throw.
+     * @param[in] options   Priority lane of the callback.
+     * @return The id of the timer, used to cancel it.
+     */
+    TimerId scheduleAfter(std::chrono::milliseconds delay, std::function<void()> callback,
+                          const TaskOptions& options = TaskOptions());
+
+    /**
+     * @brief Run a callback every period, the first time one period from now.
+     *        Runs keep a fixed rate. A run that would start while the
+     *        previous one is still busy is skipped.
+     * @param[in] period    The interval between two runs, at least one tick.
+     * @param[in] callback  The callback, run on the WorkQueue. It must not throw.
+     * @param[in] options   Priority lane of the callback.
+     * @return The id of the timer, used to cancel it.
+     */
+    TimerId scheduleEvery(std::chrono::milliseconds period, std::function<void()> callback,
+                          const TaskOptions& options = TaskOptions());
+
+    /**
+     * @brief Stop a timer. A callback already handed to the WorkQueue still runs.
+     * @return true if the timer was pending, false if it had fired or was unknown.
+     */
+    bool cancel(TimerId id);
+
+    /**
+     * @brief Get the number of pending timers.
+     */
+    size_t size() const;
+
+    std::chrono::milliseconds getTick() const { return m_tick; }
+
+protected:
+    /**
+     * @brief Construct the shared wheel, it ticks every millisecond and
+     *        runs its callbacks on the shared WorkQueue.
+     */
+    TimerWheel();
+private:
+    friend class Singleton<TimerWheel> ;
+
+    enum
+    {
+        SLOT_BITS   = 6,
+        SLOT_COUNT  = 1 << SLOT_BITS,
+        SLOT_MASK   = SLOT_COUNT - 1,
+        LEVEL_COUNT = 4,
+    };
+
+    static const uint32_t NIL = 0xffffffff;
+
+    /**
+     * Shared by the dispatched runs of a periodic timer.
+     */
+    struct Periodic
+    {
+        std::function<void()> callback;
+        std::atomic<bool>     running;
+
+        explicit Periodic(std::function<void()>&& f) : callback(std::move(f)), running(false) {}
+    };
+
+    struct Timer
+    {
+        uint32_t                   generation;
+        uint32_t                   prev;
+        uint32_t                   next;        ///< also links the free list
+        uint32_t                   bucket;      ///< level * SLOT_COUNT + slot, NIL when free
+        uint64_t                   expires;     ///< in ticks
+        uint64_t                   period;      ///< in ticks, 0 for a one-shot timer
+        std::function<void()>      callback;
+        std::shared_ptr<Periodic>  periodic;
+        TaskOptions                options;
+
+        Timer() : generation(1), prev(NIL), next(NIL), bucket(NIL), expires(0), period(0) {}
+    };
+
+    /**
+     * A callback due to be handed to the WorkQueue.
+     */
+    struct Expired
+    {
+        std::function<void()>      callback;
+        std::shared_ptr<Periodic>  periodic;
+        TaskOptions                options;
+    };
+
+    void init();
+
+    TimerId schedule(std::chrono::milliseconds delay, uint64_t period, std::function<void()>&& callback,
+                     std::shared_ptr<Periodic>&& periodic, const TaskOptions& options);
+
+    /**
+     * @brief Link a timer into the slot covering its expiry.
+     */
+    void link(uint32_t nIndex);
+
+    void unlink(uint32_t nIndex);
+
+    /**
+     * @brief Put an unlinked timer on the free list and bump its generation.
+     */
+    void release(uint32_t nIndex);
+
+    /**
+     * @brief Move the timers of a higher level slot down the wheel.
+     * @return The slot index that was cascaded, 0 when the level wrapped.
+     */
+    size_t cascade(size_t nLevel);
+
+    /**
+     * @brief Advance the wheel by one tick and collect the expired timers.
+     */
+    void advance();
+
+    /**
+     * @brief The first tick that runs or cascades a timer, UINT64_MAX when
+     *        nothing is pending. Ticks before it can be skipped.
+     */
+    uint64_t nextWakeTick() const;
+
+    uint64_t nowTick() const;
+
+    void dispatch(Expired& expired);
+
+    void runTicker();
+
+private:
+    WorkQueue*                          m_pQueue;
+    std::chrono::milliseconds           m_tick;
+    clock_type::time_point              m_start;
+    uint64_t                            m_currentTick;  ///< every tick before it is processed
+    uint64_t                            m_wakeTick;     ///< the tick the thread sleeps until
+    std::vector<Timer>                  m_timers;
+    uint32_t                            m_freeList;
+    size_t                              m_pendingCount;
+    uint32_t                            m_buckets[LEVEL_COUNT * SLOT_COUNT];  ///< list heads
+    std::vector<Expired>                m_expired;      ///< used by the tick thread only
+    mutable std::mutex                  m_lock;
+    std::condition_variable             m_wakeup;
+    std::thread                         m_thread;
+    bool                                m_quit;
+};
+
+} // namespace Foundation
+
+#endif // Foundation_TimerWheel_h
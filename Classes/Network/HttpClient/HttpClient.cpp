@@ -30,12 +30,16 @@
 #include <vector>
 #include <assert.h>
 #include "curl/curl.h"
+#include "../../Foundation/RingQueue.h"
+#include "../../Foundation/WorkQueue.h"
 #include "HttpClient.h"
 
 namespace Network {
 
-static std::mutex       s_requestQueueMutex;
-static std::mutex       s_responseQueueMutex;
+typedef Foundation::RingQueue<HttpRequest::pointer, Foundation::RingQueueMode::MPSC>  RequestQueue;
+typedef Foundation::RingQueue<HttpResponse::pointer, Foundation::RingQueueMode::SPSC> ResponseQueue;
+
+static const size_t     s_queueCapacity = 1024;
 
 static std::mutex		s_SleepMutex;
 static std::condition_variable		s_SleepCondition;
@@ -43,8 +47,8 @@ static std::condition_variable		s_SleepCondition;
 
 static bool s_need_quit = false;
 
-static std::vector<HttpRequest::pointer>*  s_requestQueue = nullptr;
-static std::vector<HttpResponse::pointer>* s_responseQueue = nullptr;
+static RequestQueue*  s_requestQueue = nullptr;
+static ResponseQueue* s_responseQueue = nullptr;
 
 static HttpClient *s_pHttpClient = nullptr; // pointer to singleton
 
@@ -104,23 +108,17 @@ void HttpClient::networkThread()
         // step 1: send http request if the requestQueue isn't empty
         request = nullptr;
         
-        s_requestQueueMutex.lock();
-        
         //Get request task from queue
-        
-        if (!s_requestQueue->empty())
-        {
-            request = s_requestQueue->at(0);
-            s_requestQueue->erase(s_requestQueue->begin());
-        }
-        
-        s_requestQueueMutex.unlock();
+        s_requestQueue->tryPop(request);
         
         if (nullptr == request)
         {
             // Wait for http request tasks from main thread
             std::unique_lock<std::mutex> lk(s_SleepMutex); 
-            s_SleepCondition.wait(lk);
+            if (s_requestQueue->empty() && !s_need_quit)
+            {
+                s_SleepCondition.wait(lk);
+            }
             continue;
         }
         
@@ -196,9 +194,10 @@ void HttpClient::networkThread()
 
         
         // add response packet into queue
-        s_responseQueueMutex.lock();
-        s_responseQueue->push_back(response);
-        s_responseQueueMutex.unlock();
+        while (!s_responseQueue->tryPush(response))
+        {
+            dispatchResponseCallbacks();
+        }
         
         if (nullptr != s_pHttpClient) 
         {
@@ -208,10 +207,9 @@ void HttpClient::networkThread()
     }
     
     // cleanup: if worker thread received quit signal, clean up un-completed request queue
-    s_requestQueueMutex.lock();
-    s_requestQueue->clear();
-    s_requestQueueMutex.unlock();
-    
+    while (s_requestQueue->tryPop(request))
+    {
+    }
     
     if (s_requestQueue != nullptr) {
         delete s_requestQueue;
@@ -434,8 +432,8 @@ bool HttpClient::lazyInitThreadSemphore()
         return true;
     } else {
         
-        s_requestQueue = new std::vector<HttpRequest::pointer>();
-        s_responseQueue = new std::vector<HttpResponse::pointer>();
+        s_requestQueue = new RequestQueue(s_queueCapacity);
+        s_responseQueue = new ResponseQueue(s_queueCapacity);
         
         auto t = std::thread(std::bind(&HttpClient::networkThread, this));
         t.detach();
@@ -463,14 +461,54 @@ bool HttpClient::sendAsynchronousRequest(HttpRequest::pointer request)
         return false;
     }
 
-    s_requestQueueMutex.lock();
-    s_requestQueue->push_back(request);
-    s_requestQueueMutex.unlock();
+    // The queue is bounded, refuse the request when it is full
+    if (!s_requestQueue->tryPush(request))
+    {
+        return false;
+    }
     // Notify thread start to work
+    {
+        std::lock_guard<std::mutex> lk(s_SleepMutex);
+    }
     s_SleepCondition.notify_one();
     return true;
 }
 
+#if FOUNDATION_HAS_COROUTINES
+HttpClient::ResponseAwaiter::ResponseAwaiter(HttpClient* client, HttpRequest::pointer request)
+: _client(client)
+, _request(request)
+{
+}
+
+bool HttpClient::ResponseAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    // The callback runs on the network thread, the coroutine is resumed on
+    // the WorkQueue so that it does not hold up the other requests.
+    _request->setResponseCallback([this, handle](HttpClient*, HttpResponse::pointer response)
+    {
+        _response = response;
+        Foundation::WorkQueue::getInstance()->post([handle]{ handle.resume(); });
+    });
+
+    if (!_client->sendAsynchronousRequest(_request))
+    {
+        _request->setResponseCallback(nullptr);
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<HttpResponse> HttpClient::ResponseAwaiter::await_resume()
+{
+    // The callback points at this awaiter, which is gone once the coroutine
+    // moves on. dispatchResponseCallbacks runs a copy, so it may be reset
+    // while that copy is still returning.
+    _request->setResponseCallback(nullptr);
+    return std::move(_response);
+}
+#endif
+
 // Poll and notify main thread if responses exists in queue
 void HttpClient::dispatchResponseCallbacks()
 {
@@ -481,20 +519,13 @@ void HttpClient::dispatchResponseCallbacks()
     }
     HttpResponse::pointer response = nullptr;
     
-    s_responseQueueMutex.lock();
-
-    if (!s_responseQueue->empty())
-    {
-        response = s_responseQueue->at(0);
-        s_responseQueue->erase(s_responseQueue->begin());
-    }
-    
-    s_responseQueueMutex.unlock();
+    s_responseQueue->tryPop(response);
     
     if (response)
     {
         HttpRequest::pointer request = response->getHttpRequest();
-        const ccHttpRequestCallback& callback = request->getCallback();
+        // A copy, the callback may reset the one of the request before it returns.
+        ccHttpRequestCallback callback = request->getCallback();
         if (callback != nullptr)
         {
             callback(this, response);
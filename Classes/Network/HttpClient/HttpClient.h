@@ -5,6 +5,11 @@
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "HttpClient.h"
+#include "../../Foundation/FoundationMacros.h"
+
+#if FOUNDATION_HAS_COROUTINES
+    #include <coroutine>
+#endif
 
 namespace Network {
 
@@ -64,6 +69,34 @@ public:
      * @return int
      */
     inline int getTimeoutForRead() {return _timeoutForRead;};
+
+#if FOUNDATION_HAS_COROUTINES
+    /** Awaitable of sendRequest, yields the response of the request. */
+    class ResponseAwaiter
+    {
+    public:
+        ResponseAwaiter(HttpClient* client, HttpRequest::pointer request);
+
+        bool await_ready() const { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle);
+
+        std::shared_ptr<HttpResponse> await_resume();
+
+    private:
+        HttpClient*                     _client;
+        HttpRequest::pointer            _request;
+        std::shared_ptr<HttpResponse>   _response;
+    };
+
+    /**
+     * co_await sendRequest(request) sends the request asynchronously and resumes
+     * the coroutine on the shared WorkQueue with the response.
+     * The callback of the request is replaced, the response is nullptr when
+     * the request queue is full.
+     */
+    inline ResponseAwaiter sendRequest(HttpRequest::pointer request) {return ResponseAwaiter(this, request);}
+#endif
         
 private:
     HttpClient();
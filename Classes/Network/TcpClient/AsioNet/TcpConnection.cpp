@@ -4,20 +4,31 @@
  ****************************************************************************/
 
 #include <iostream>
+#include <cassert>
+#include <stdexcept>
 #include "TcpConnection.h"
+#include "../../../Foundation/WorkQueue.h"
 
 namespace Framework{
 
 TcpConnection::TcpConnection():
 	m_socket(m_ioServer), 
-	m_heartBeatTimer(m_ioServer),
+	m_messages(1024),
+	m_overflowing(false),
+	m_writeInProgress(false),
+	m_heartBeatTimer(Foundation::TimerWheel::INVALID_TIMER),
 	m_reconnectTimer(m_ioServer),
 	m_delimiter("\0"),
 	m_heartBeat("PING"),
 	m_heartBeatTimeOut(5),
 	m_reconnectTimeOut(5)
 {	
-
+#if FOUNDATION_HAS_COROUTINES
+	m_pReader = nullptr;
+	m_readerWaiting = false;
+	m_readByCoroutine = false;
+	m_closed = false;
+#endif
 }
 
 TcpConnection::~TcpConnection(void)
@@ -91,8 +102,20 @@ void TcpConnection::disconnect()
 
 void TcpConnection::write(const std::string &msg)
 {
-	// safe way to request the client to write a message
-	m_ioServer.post(boost::bind(&TcpConnection::do_write, shared_from_this(), msg));
+	// hand the message over without a lock, the io thread only needs
+	// to be woken up when it is not already draining the queue
+	std::string message = msg + m_delimiter;
+	if (m_overflowing || !m_messages.tryPush(std::move(message)))
+	{
+		// once a message overflowed, the later ones follow it to keep the order
+		std::lock_guard<std::mutex> lock(m_overflowMutex);
+		m_overflow.push_back(std::move(message));
+		m_overflowing = true;
+	}
+	if (!m_writeInProgress.exchange(true))
+	{
+		m_ioServer.post(boost::bind(&TcpConnection::do_write, shared_from_this()));
+	}
 }
 
 void TcpConnection::close()
@@ -114,12 +137,14 @@ void TcpConnection::handle_connect(const boost::system::error_code& error)
 {
 	if (!error) 
 	{
+#if FOUNDATION_HAS_COROUTINES
+		m_closed = false;
+#endif
 		// let listeners know
 		ConnectedCallback(m_endPoint);
 
 		// start heartbeat timer (optional)	
-		m_heartBeatTimer.expires_from_now(boost::posix_time::seconds(m_heartBeatTimeOut));
-		m_heartBeatTimer.async_wait(boost::bind(&TcpConnection::do_heartbeat, shared_from_this(), boost::asio::placeholders::error));
+		restart_heartbeat();
 
 		// await the first message
 		read();
@@ -147,12 +172,24 @@ void TcpConnection::handle_read(const boost::system::error_code& error)
 		// TODO: you could do some message processing here, like breaking it up
 		//       into smaller parts, rejecting unknown messages or handling the message protocol
 
-		// create function to notify listeners
+		// create function to notify listeners, a waiting coroutine comes first
+#if FOUNDATION_HAS_COROUTINES
+		if (m_pReader != nullptr)
+		{
+			resume_reader(msg);
+		}
+		else if (m_readByCoroutine || m_readerWaiting)
+		{
+			// the coroutine is between two awaits, keep it for the next one
+			m_readByCoroutine = true;
+			m_unread.push_back(msg);
+		}
+		else
+#endif
 		MessageCallback(msg);
 
 		// restart heartbeat timer (optional)	
-		m_heartBeatTimer.expires_from_now(boost::posix_time::seconds(m_heartBeatTimeOut));
-		m_heartBeatTimer.async_wait(boost::bind(&TcpConnection::do_heartbeat, shared_from_this(), boost::asio::placeholders::error));
+		restart_heartbeat();
 
 		// wait for the next message
 		read();
@@ -182,19 +219,13 @@ void TcpConnection::handle_write(const boost::system::error_code& error)
 {
 	if(!error)
 	{
-		// write next message
-		m_messages.pop_front();
-		if (!m_messages.empty())
+		if (m_spilled.empty() && m_messages.empty() && !m_overflowing)
 		{
-			boost::asio::async_write(m_socket,
-				boost::asio::buffer(m_messages.front()),
-				boost::bind(&TcpConnection::handle_write, this, boost::asio::placeholders::error));
-		}
-		else {
 			// restart heartbeat timer (optional)	
-			m_heartBeatTimer.expires_from_now(boost::posix_time::seconds(m_heartBeatTimeOut));
-			m_heartBeatTimer.async_wait(boost::bind(&TcpConnection::do_heartbeat, shared_from_this(), boost::asio::placeholders::error));
+			restart_heartbeat();
 		}
+		// write next message
+		do_write();
 	}
 	else if (error)
 	{
@@ -202,17 +233,50 @@ void TcpConnection::handle_write(const boost::system::error_code& error)
 	}
 }
 
-void TcpConnection::do_write(const std::string &msg)
+void TcpConnection::do_write()
+{
+	while (!next_message())
+	{
+		m_writeInProgress = false;
+		// a writer may have queued a message after the failed pop and
+		// seen the flag still set, take the queue back in that case
+		if ((m_messages.empty() && !m_overflowing) || m_writeInProgress.exchange(true))
+		{
+			return;
+		}
+	}
+
+	boost::asio::async_write(m_socket,
+		boost::asio::buffer(m_writingMessage),
+		boost::bind(&TcpConnection::handle_write, shared_from_this(), boost::asio::placeholders::error));
+}
+
+bool TcpConnection::next_message()
 {
-	bool write_in_progress = !m_messages.empty();
-	m_messages.push_back(msg + m_delimiter);
+	// the overflow taken over last time goes first, then the ring, which
+	// only holds messages older than the current overflow
+	if (m_spilled.empty())
+	{
+		if (m_messages.tryPop(m_writingMessage))
+		{
+			return true;
+		}
+		if (!m_overflowing)
+		{
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(m_overflowMutex);
+		m_spilled.swap(m_overflow);
+		m_overflowing = false;
+	}
 
-	if (!write_in_progress)
+	if (m_spilled.empty())
 	{
-		boost::asio::async_write(m_socket,
-			boost::asio::buffer(m_messages.front()),
-			boost::bind(&TcpConnection::handle_write, shared_from_this(), boost::asio::placeholders::error));
+		return false;
 	}
+	m_writingMessage = std::move(m_spilled.front());
+	m_spilled.pop_front();
+	return true;
 }
 
 void TcpConnection::do_close()
@@ -223,8 +287,16 @@ void TcpConnection::do_close()
 		m_socket.shutdown(boost::asio::socket_base::shutdown_both, err);
 		m_socket.close(err);
 	}
-	m_heartBeatTimer.cancel();
+	Foundation::TimerWheel::getInstance()->cancel(m_heartBeatTimer);
+	m_heartBeatTimer = Foundation::TimerWheel::INVALID_TIMER;
 	m_reconnectTimer.cancel();
+#if FOUNDATION_HAS_COROUTINES
+	m_closed = true;
+	if (m_pReader != nullptr)
+	{
+		resume_reader(std::string());
+	}
+#endif
 	CloseCallback(m_endPoint);
 }
 
@@ -241,13 +313,79 @@ void TcpConnection::do_reconnect(const boost::system::error_code& error)
 	}
 }
 
-void TcpConnection::do_heartbeat(const boost::system::error_code& error)
+void TcpConnection::do_heartbeat()
 {
 	// here you can regularly send a message to the server to keep the connection alive,
 	// I usualy send a PING and then the server replies with a PONG
 
-	if(!error) write( m_heartBeat );
+	write( m_heartBeat );
+}
+
+void TcpConnection::restart_heartbeat()
+{
+	// one wheel serves the heartbeats of all connections, the callback runs
+	// on the WorkQueue and only keeps a weak reference to the connection
+	Foundation::TimerWheel* pWheel = Foundation::TimerWheel::getInstance();
+	pWheel->cancel(m_heartBeatTimer);
+
+	weak_pointer self(shared_from_this());
+	m_heartBeatTimer = pWheel->scheduleAfter(std::chrono::seconds(m_heartBeatTimeOut), [self]
+	{
+		if (pointer connection = self.lock())
+		{
+			connection->do_heartbeat();
+		}
+	});
+}
+
+#if FOUNDATION_HAS_COROUTINES
+void TcpConnection::MessageAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+	// m_pReader holds a single coroutine, a second one would overwrite it;
+	// throwing here resumes the second coroutine with the exception
+	if (m_pConnection->m_readerWaiting.exchange(true))
+	{
+		throw std::logic_error("TcpConnection::readMessage: another coroutine is already waiting");
+	}
+
+	// the reader is registered on the io thread, like every other state change
+	m_handle = handle;
+	m_pConnection->m_ioServer.post(boost::bind(&TcpConnection::do_await_message, m_pConnection->shared_from_this(), this));
+}
+
+void TcpConnection::do_await_message(MessageAwaiter* pAwaiter)
+{
+	assert(m_pReader == nullptr);
+	m_pReader = pAwaiter;
+	m_readByCoroutine = true;
+
+	// messages kept since the last await come first, a closed connection
+	// will not read again and resumes with an empty message
+	if (!m_unread.empty())
+	{
+		std::string message = std::move(m_unread.front());
+		m_unread.pop_front();
+		resume_reader(message);
+	}
+	else if (m_closed)
+	{
+		resume_reader(std::string());
+	}
+}
+
+void TcpConnection::resume_reader(const std::string& message)
+{
+	MessageAwaiter* pReader = m_pReader;
+	m_pReader = nullptr;
+	pReader->m_message = message;
+
+	// the resumed coroutine may await again as soon as it runs
+	m_readerWaiting = false;
+
+	std::coroutine_handle<> handle = pReader->m_handle;
+	Foundation::WorkQueue::getInstance()->post([handle]{ handle.resume(); });
 }
+#endif
 
 }//namespace snailgame
 
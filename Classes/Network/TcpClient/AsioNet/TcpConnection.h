@@ -22,7 +22,16 @@
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <atomic>
+#include <chrono>
 #include <deque>
+#include <mutex>
+#include "../../../Foundation/RingQueue.h"
+#include "../../../Foundation/TimerWheel.h"
+
+#if FOUNDATION_HAS_COROUTINES
+	#include <coroutine>
+#endif
 
 namespace Framework{
 
@@ -41,7 +50,7 @@ public:
 	void update();
 
 	/**
-	 * @brief Send message to server
+	 * @brief Send message to server, may be called from any thread.
 	 * @param[in] msg Want to send a message.
 	 */
 	void write(const std::string &msg);
@@ -112,6 +121,41 @@ public:
 	 * @param[in] timeOut Time value (second).
 	 */
 	void setreconnectTimeOut(size_t timeOut){m_reconnectTimeOut = timeOut; };
+
+#if FOUNDATION_HAS_COROUTINES
+	/**
+	 * @brief Awaitable of readMessage, yields the next message from the server.
+	 */
+	class MessageAwaiter
+	{
+	public:
+		explicit MessageAwaiter(TcpConnection* pConnection) : m_pConnection(pConnection) {}
+
+		bool await_ready() const { return false; }
+
+		void await_suspend(std::coroutine_handle<> handle);
+
+		std::string await_resume() { return std::move(m_message); }
+
+	private:
+		friend class TcpConnection;
+
+		TcpConnection*				m_pConnection;
+		std::coroutine_handle<>		m_handle;
+		std::string					m_message;
+	};
+
+	/**
+	 * @brief co_await readMessage() waits for the next message and resumes
+	 *        the coroutine on the shared WorkQueue. Once a coroutine has
+	 *        awaited, messages go to it instead of MessageCallback, the ones
+	 *        arriving between two awaits are kept for the next await. One
+	 *        coroutine may wait at a time, a second await throws
+	 *        std::logic_error.
+	 * @return An empty message when the connection is closed.
+	 */
+	MessageAwaiter readMessage(){ return MessageAwaiter(this); };
+#endif
 public:
 
 	/**
@@ -132,10 +176,25 @@ protected:
 	virtual void handle_read(const boost::system::error_code& error);
 	virtual void handle_write(const boost::system::error_code& error);
 
-	virtual void do_write(const std::string &msg);
+	virtual void do_write();
 	virtual void do_close();
 	virtual void do_reconnect(const boost::system::error_code& error);
-	virtual void do_heartbeat(const boost::system::error_code& error);
+	virtual void do_heartbeat();
+
+#if FOUNDATION_HAS_COROUTINES
+	// register the coroutine waiting for a message, or resume it at once
+	// with a kept message or on a closed connection, runs on the io thread
+	void do_await_message(MessageAwaiter* pAwaiter);
+
+	// hand a message to the waiting coroutine and resume it on the WorkQueue
+	void resume_reader(const std::string& message);
+#endif
+
+	// (re)arm the heartbeat on the shared TimerWheel
+	void restart_heartbeat();
+
+	// take the next message to write into m_writingMessage, runs on the io thread
+	bool next_message();
 protected:
 	boost::asio::ip::tcp::endpoint	m_endPoint;
 
@@ -144,10 +203,28 @@ protected:
 
 	boost::asio::streambuf			m_buffer;
 
-	//! to be written to server
-	std::deque<std::string>			m_messages;	
+	//! to be written to server, filled by write() on any thread
+	Foundation::RingQueue<std::string, Foundation::RingQueueMode::MPSC> m_messages;
+
+	//! messages written while m_messages was full, in order
+	std::deque<std::string>			m_overflow;
+	std::mutex						m_overflowMutex;
+
+	//! writers skip m_messages while set, so the overflow keeps its order
+	std::atomic<bool>				m_overflowing;
+
+	//! the overflow taken over by the io thread, sent before m_messages
+	std::deque<std::string>			m_spilled;
+
+	//! the message being written by async_write
+	std::string						m_writingMessage;
+
+	//! set while the io thread drains m_messages
+	std::atomic<bool>				m_writeInProgress;
+
+	//! pending heartbeat on the shared TimerWheel, touched by the io thread only
+	Foundation::TimerWheel::TimerId	m_heartBeatTimer;
 
-	boost::asio::deadline_timer		m_heartBeatTimer;
 	boost::asio::deadline_timer		m_reconnectTimer;
 
 	std::string						m_delimiter;
@@ -155,6 +232,23 @@ protected:
 
 	size_t                          m_heartBeatTimeOut;
 	size_t                          m_reconnectTimeOut;
+
+#if FOUNDATION_HAS_COROUTINES
+	//! the coroutine waiting in readMessage, touched by the io thread only
+	MessageAwaiter*					m_pReader;
+
+	//! set from await_suspend until the reader is resumed
+	std::atomic<bool>				m_readerWaiting;
+
+	//! set once a coroutine reads the messages, touched by the io thread only
+	bool							m_readByCoroutine;
+
+	//! messages no coroutine was waiting for, touched by the io thread only
+	std::deque<std::string>			m_unread;
+
+	//! set by do_close until the next connect, touched by the io thread only
+	bool							m_closed;
+#endif
 };
 
 }//namespace Framework
@@ -5,115 +5,684 @@
 
 ****************************************************************************/
 
+#include <algorithm>
+#include <cstdio>
 #include "NotificationCenter.h"
+#include "Foundation/FoundationMacros.h"
+#include "Foundation/WorkQueue.h"
 namespace Foundation{
 std::shared_ptr<NotificationCenter> NotificationCenter::m_defaultCenter = nullptr;
 
-NotificationCenter::observer_const_iterator NotificationCenter::addObserver(std::function<void()> method, const std::string& name)
+namespace {
+
+std::atomic<uint64_t> s_nextSerial(1);
+
+/**
+ * The deferred buffers the current thread used last, by center serial.
+ * A destroyed center's serial is never reused, so stale entries never match.
+ */
+struct DeferredCacheEntry
+{
+    uint64_t serial;
+    void*    buffer;
+};
+
+enum { DEFERRED_CACHE_SIZE = 4 };
+
+FOUNDATION_THREAD_LOCAL DeferredCacheEntry s_deferredCache[DEFERRED_CACHE_SIZE];
+FOUNDATION_THREAD_LOCAL unsigned           s_deferredCacheNext;
+
+} // namespace
+
+NotificationCenter::observer_list::observer_list(size_t capacity)
+    : metrics(nullptr)
+    , m_entries(new Entry[capacity])
+    , m_capacity(capacity)
+    , m_size(0)
+    , m_removed(0)
+{
+}
+
+void NotificationCenter::observer_list::append(const NotificationObserver& observer)
+{
+    // Posts read no further than the size, the new entry is complete before it grows.
+    size_t nSize = m_size.load(std::memory_order_relaxed);
+    m_entries[nSize].observer = observer;
+    m_size.store(nSize + 1, std::memory_order_release);
+}
+
+void NotificationCenter::observer_list::remove(size_t position)
+{
+    m_entries[position].removed.store(true, std::memory_order_relaxed);
+    ++m_removed;
+}
+
+void* NotificationCenter::observer_table::find(uint64_t key) const
+{
+    if (slots.empty())
+    {
+        return nullptr;
+    }
+    size_t mask = slots.size() - 1;
+    for (size_t i = static_cast<size_t>(key) & mask; ; i = (i + 1) & mask)
+    {
+        const Slot& slot = slots[i];
+        if (slot.id == key)
+        {
+            return slot.observers.get();
+        }
+        if (slot.id == 0)
+        {
+            return nullptr;
+        }
+    }
+}
+
+std::shared_ptr<const NotificationCenter::observer_table> NotificationCenter::observer_table::with(
+    uint64_t key, std::shared_ptr<void> observers) const
+{
+    size_t nCount = observers ? 1 : 0;
+    for (auto& slot : slots)
+    {
+        if (slot.id != 0 && slot.id != key)
+        {
+            ++nCount;
+        }
+    }
+
+    size_t nCapacity = 8;
+    while (nCapacity < nCount * 2)
+    {
+        nCapacity *= 2;
+    }
+
+    std::shared_ptr<observer_table> table = std::make_shared<observer_table>();
+    table->slots.resize(nCapacity);
+    auto insert = [&table, nCapacity](uint64_t id, const std::shared_ptr<void>& list)
+    {
+        size_t i = static_cast<size_t>(id) & (nCapacity - 1);
+        while (table->slots[i].id != 0)
+        {
+            i = (i + 1) & (nCapacity - 1);
+        }
+        table->slots[i].id = id;
+        table->slots[i].observers = list;
+    };
+
+    for (auto& slot : slots)
+    {
+        if (slot.id != 0 && slot.id != key)
+        {
+            insert(slot.id, slot.observers);
+        }
+    }
+    if (observers)
+    {
+        insert(key, observers);
+    }
+    return table;
+}
+
+NotificationCenter::NotificationCenter()
+    : m_observers(std::make_shared<observer_table>())
+    , m_channels(std::make_shared<observer_table>())
+    , m_topics(std::make_shared<topic_index>())
+    , m_nextHandle(INVALID_OBSERVER + 1)
+    , m_asyncCount(0)
+    , m_serial(s_nextSerial++)
+    , m_deferredBuffers(nullptr)
+    , m_metricsEnabled(false)
+    , m_slowBudget(1000000)
+{
+}
+
+NotificationCenter::~NotificationCenter()
+{
+    std::unique_lock<std::mutex> lock(m_asyncMutex);
+    m_asyncDone.wait(lock, [this]{ return m_asyncCount == 0; });
+
+    DeferredBuffer* pBuffer = m_deferredBuffers.load();
+    while (pBuffer != nullptr)
+    {
+        DeferredBuffer* pNext = pBuffer->next;
+        delete pBuffer;
+        pBuffer = pNext;
+    }
+}
+
+void NotificationCenter::publish(std::shared_ptr<const observer_table> table)
+{
+    m_observers.store(std::move(table));
+}
+
+ObserverHandle NotificationCenter::addObserver(std::function<void()> method, NotificationId name)
+{
+    return addObserver(method, name, nullptr);
+}
+
+NotificationCenter::HandleSlot* NotificationCenter::slotOf(ObserverHandle handle)
+{
+    size_t nIndex = static_cast<size_t>(handle & 0xffffffff);
+    uint32_t generation = static_cast<uint32_t>(handle >> 32);
+    if (nIndex >= m_handleSlots.size() || m_handleSlots[nIndex].generation != generation || m_handleSlots[nIndex].id == 0)
+    {
+        return nullptr;
+    }
+    return &m_handleSlots[nIndex];
+}
+
+void NotificationCenter::releaseSlot(ObserverHandle handle)
+{
+    uint32_t nIndex = static_cast<uint32_t>(handle & 0xffffffff);
+    HandleSlot& slot = m_handleSlots[nIndex];
+    slot.id = 0;
+    // Generation 0 would let a handle be 0, INVALID_OBSERVER.
+    if (++slot.generation == 0)
+    {
+        slot.generation = 1;
+    }
+    m_freeSlots.push_back(nIndex);
+}
+
+std::shared_ptr<NotificationCenter::observer_list> NotificationCenter::compact(const observer_list* pOld, size_t nExtra)
+{
+    size_t nLive = pOld != nullptr ? pOld->size() - pOld->removedCount() : 0;
+    std::shared_ptr<observer_list> observers = std::make_shared<observer_list>(std::max<size_t>(4, (nLive + nExtra) * 2));
+    if (pOld != nullptr)
+    {
+        observers->metrics.store(pOld->metrics.load());
+        for (size_t i = 0, n = pOld->size(); i < n; ++i)
+        {
+            const observer_list::Entry& entry = (*pOld)[i];
+            if (!entry.removed.load(std::memory_order_relaxed))
+            {
+                slotOf(entry.observer.handle)->position = observers->size();
+                observers->append(entry.observer);
+            }
+        }
+    }
+    return observers;
+}
+
+ObserverHandle NotificationCenter::addObserver(std::function<void()> method, NotificationId name, NotificationInbox::pointer inbox)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t nIndex = 0;
+    if (!m_freeSlots.empty())
+    {
+        nIndex = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        nIndex = static_cast<uint32_t>(m_handleSlots.size());
+        m_handleSlots.push_back(HandleSlot());
+    }
+    HandleSlot& slot = m_handleSlots[nIndex];
+
     NotificationObserver n;
     n.callback = method;
-    m_observers[name].push_back(n);
-    return --m_observers[name].end();
+    n.handle = (static_cast<ObserverHandle>(slot.generation) << 32) | nIndex;
+    n.inbox = inbox;
+
+    const observer_table* current = m_observers.get();
+    observer_list* observers = static_cast<observer_list*>(current->find(name.value()));
+    if (observers == nullptr || observers->size() == observers->capacity())
+    {
+        std::shared_ptr<observer_list> grown = compact(observers, 1);
+        slot.id = name.value();
+        slot.position = grown->size();
+        grown->append(n);
+        publish(current->with(name.value(), grown));
+    }
+    else
+    {
+        slot.id = name.value();
+        slot.position = observers->size();
+        observers->append(n);
+    }
+    return n.handle;
 }
 
-NotificationCenter::observer_const_iterator NotificationCenter::addObserver(std::function<void (void)> method, notification_iterator &notification)
+void NotificationCenter::removeObserver(NotificationId name, ObserverHandle observer)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
-    NotificationCenter::observer_const_iterator retVal = notification->second.end();
-    if (notification != m_observers.end())
+    HandleSlot* pSlot = slotOf(observer);
+    if (pSlot == nullptr || pSlot->id != name.value())
+    {
+        return;
+    }
+
+    const observer_table* current = m_observers.get();
+    observer_list* observers = static_cast<observer_list*>(current->find(name.value()));
+    observers->remove(pSlot->position);
+    releaseSlot(observer);
+
+    // A removed entry keeps its callback and inbox alive until the list is
+    // compacted. A short list is compacted at once, that also covers the
+    // last observer going; a long one once the removed entries outnumber
+    // the live ones.
+    if (observers->size() < COMPACT_THRESHOLD || observers->removedCount() * 2 > observers->size())
     {
-        NotificationObserver n;
-        n.callback = method;
-        notification->second.push_back(n);
-        retVal = --notification->second.end();
+        publish(current->with(name.value(), compact(observers, 0)));
     }
-    return retVal;
 }
 
-void NotificationCenter::removeObserver(const std::string& name, std::list<NotificationObserver>::const_iterator& observer)
+void NotificationCenter::removeObservers(NotificationId name)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
-    notification_iterator notification = m_observers.find(name);
-    if (notification != m_observers.end())
+    const observer_table* current = m_observers.get();
+    const observer_list* observers = static_cast<const observer_list*>(current->find(name.value()));
+    if (observers != nullptr)
     {
-        notification->second.erase(observer);
+        for (size_t i = 0, n = observers->size(); i < n; ++i)
+        {
+            const observer_list::Entry& entry = (*observers)[i];
+            if (!entry.removed.load(std::memory_order_relaxed))
+            {
+                releaseSlot(entry.observer.handle);
+            }
+        }
+        publish(current->with(name.value(), nullptr));
     }
 }
 
-void NotificationCenter::removeObserver(notification_iterator& notification, std::list<NotificationObserver>::const_iterator& observer)
+bool NotificationCenter::deliver(NotificationId name) const
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    if (notification != m_observers.end())
+    // The guard keeps the observer list alive while the callbacks run, an
+    // observer queued to an inbox holds a reference of the snapshot instead.
+    Epoch::Guard guard;
+    const observer_table* table = m_observers.get();
+    const observer_list* notiList = static_cast<const observer_list*>(table->find(name.value()));
+    if (notiList == nullptr)
+    {
+        return false;
+    }
+
+    DeliveryMetrics* pMetrics = m_metricsEnabled.load(std::memory_order_relaxed) ? metricsOf(*notiList, name) : nullptr;
+    std::shared_ptr<const void> owner;
+    uint64_t nFanOut = 0;
+    for (size_t i = 0, n = notiList->size(); i < n; ++i)
+    {
+        const observer_list::Entry& entry = (*notiList)[i];
+        if (entry.removed.load(std::memory_order_relaxed))
+        {
+            continue;
+        }
+        ++nFanOut;
+        if (entry.observer.inbox && !owner)
+        {
+            owner = table->shared_from_this();
+        }
+        if (pMetrics == nullptr || entry.observer.inbox)
+        {
+            invoke(entry.observer, owner);
+            continue;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        invoke(entry.observer, owner);
+        long long nTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        pMetrics->latency.record(nTime > 0 ? static_cast<uint64_t>(nTime) : 0);
+        if (nTime > 0 && static_cast<uint64_t>(nTime) > m_slowBudget.load(std::memory_order_relaxed))
+        {
+            reportSlow(entry.observer, name, static_cast<uint64_t>(nTime));
+        }
+    }
+
+    if (pMetrics != nullptr)
+    {
+        pMetrics->posts.fetch_add(1, std::memory_order_relaxed);
+        pMetrics->deliveries.fetch_add(nFanOut, std::memory_order_relaxed);
+        uint64_t nMax = pMetrics->maxFanOut.load(std::memory_order_relaxed);
+        while (nFanOut > nMax && !pMetrics->maxFanOut.compare_exchange_weak(nMax, nFanOut, std::memory_order_relaxed))
+        {
+        }
+    }
+    return true;
+}
+
+NotificationCenter::DeliveryMetrics* NotificationCenter::metricsOf(const observer_list& observers, NotificationId name) const
+{
+    void* p = observers.metrics.load(std::memory_order_acquire);
+    if (p != nullptr)
+    {
+        return static_cast<DeliveryMetrics*>(p);
+    }
+
+    // Metrics are kept by id, so a list replaced before it could share its
+    // pointer still finds the same counters.
+    std::lock_guard<std::mutex> lock(m_metricsMutex);
+    std::unique_ptr<DeliveryMetrics>& metrics = m_metrics[name.value()];
+    if (!metrics)
+    {
+        metrics.reset(new DeliveryMetrics(name.value()));
+    }
+    observers.metrics.store(metrics.get(), std::memory_order_release);
+    return metrics.get();
+}
+
+void NotificationCenter::reportSlow(const NotificationObserver& observer, NotificationId name, uint64_t nTime) const
+{
+    std::lock_guard<std::mutex> lock(m_metricsMutex);
+    NotificationMetrics::SlowObserver& slow = m_slowObservers[observer.handle];
+    slow.handle = observer.handle;
+    slow.id = name.value();
+    ++slow.slowCalls;
+    slow.worstTime = std::max(slow.worstTime, nTime);
+}
+
+void NotificationCenter::setMetricsEnabled(bool enabled)
+{
+    m_metricsEnabled = enabled;
+}
+
+void NotificationCenter::setSlowObserverBudget(std::chrono::microseconds budget)
+{
+    m_slowBudget = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(budget).count());
+}
+
+NotificationMetrics NotificationCenter::getMetrics() const
+{
+    NotificationMetrics metrics;
+    std::lock_guard<std::mutex> lock(m_metricsMutex);
+    metrics.notifications.reserve(m_metrics.size());
+    for (auto& i : m_metrics)
+    {
+        const DeliveryMetrics& counters = *i.second;
+        NotificationMetrics::Notification notification;
+        notification.id = counters.id;
+        notification.posts = counters.posts.load(std::memory_order_relaxed);
+        notification.deliveries = counters.deliveries.load(std::memory_order_relaxed);
+        notification.maxFanOut = counters.maxFanOut.load(std::memory_order_relaxed);
+        counters.latency.mergeInto(notification.latency);
+        metrics.notifications.push_back(notification);
+    }
+    for (auto& i : m_slowObservers)
+    {
+        metrics.slowObservers.push_back(i.second);
+    }
+    return metrics;
+}
+
+void NotificationCenter::invoke(const NotificationObserver& observer, const std::shared_ptr<const void>& owner)
+{
+    if (observer.inbox)
+    {
+        observer.inbox->push(NotificationInbox::item_type(owner, &observer.callback));
+    }
+    else
     {
-        notification->second.erase(observer);
+        observer.callback();
     }
 }
 
-void NotificationCenter::removeObservers(const std::string& name)
+ObserverHandle NotificationCenter::addTopicObserver(std::function<void()> method, const std::string& pattern, NotificationInbox::pointer inbox)
 {
+    TopicSubscription subscription;
+    subscription.pattern = pattern;
+    subscription.observer.callback = method;
+    subscription.observer.handle = m_nextHandle++;
+    subscription.observer.inbox = inbox;
+
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_observers.erase(name);
+    std::vector<TopicSubscription> subscriptions = m_topics.get()->subscriptions;
+    subscriptions.push_back(subscription);
+    publishTopics(std::move(subscriptions));
+    return subscription.observer.handle;
 }
 
-void NotificationCenter::removeAllObservers(notification_iterator& notification)
+void NotificationCenter::removeTopicObserver(ObserverHandle observer)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
-    if (notification != m_observers.end())
+    std::vector<TopicSubscription> subscriptions = m_topics.get()->subscriptions;
+    auto i = std::find_if(subscriptions.begin(), subscriptions.end(),
+        [observer](const TopicSubscription& s){ return s.observer.handle == observer; });
+    if (i != subscriptions.end())
     {
-        m_observers.erase(notification);
+        subscriptions.erase(i);
+        publishTopics(std::move(subscriptions));
     }
 }
 
-bool NotificationCenter::postNotification(const std::string& name) const
+void NotificationCenter::publishTopics(std::vector<TopicSubscription> subscriptions)
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    notification_const_iterator i = m_observers.find(name);
-    if (i != m_observers.end())
+    std::shared_ptr<topic_index> index = std::make_shared<topic_index>();
+    index->subscriptions.swap(subscriptions);
+    for (size_t i = 0; i < index->subscriptions.size(); ++i)
     {
-        const std::list<NotificationObserver>& notiList = i->second;
-        for (auto& ia : notiList)
+        index->trie.insert(index->subscriptions[i].pattern, i);
+    }
+    m_topics.store(index);
+}
+
+const NotificationCenter::TopicMatches* NotificationCenter::topic_index::find(const std::string& topic, uint64_t nHash) const
+{
+    CacheSlot* pSet = &cache[(nHash % CACHE_SETS) * CACHE_WAYS];
+    for (size_t i = 0; i < CACHE_WAYS; ++i)
+    {
+        const TopicMatches* matches = pSet[i].matches.get();
+        if (matches != nullptr && matches->topic == topic)
         {
-            ia.callback();
+            // Only written when it changes, hits keep the line shared.
+            if (!pSet[i].used.load(std::memory_order_relaxed))
+            {
+                pSet[i].used.store(true, std::memory_order_relaxed);
+            }
+            return matches;
         }
-        return true;
     }
-    else
+    return nullptr;
+}
+
+const NotificationCenter::TopicMatches* NotificationCenter::topic_index::insert(const std::string& topic, uint64_t nHash) const
+{
+    std::shared_ptr<TopicMatches> matches = std::make_shared<TopicMatches>();
+    matches->topic = topic;
+    matches->values = trie.match(topic);
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    // Another post may have cached it meanwhile.
+    const TopicMatches* pCached = find(topic, nHash);
+    if (pCached != nullptr)
     {
-        printf("WARNING: Notification \"%s\" does not exist.\n", name.data());
-        return false;
+        return pCached;
+    }
+
+    // An empty way, or else the first one not used since the last eviction.
+    // Passing over a used way clears its mark, so the second round finds
+    // one unless posts keep marking them all.
+    CacheSlot* pSet = &cache[(nHash % CACHE_SETS) * CACHE_WAYS];
+    CacheSlot* pVictim = &pSet[0];
+    for (size_t i = 0; i < 2 * CACHE_WAYS; ++i)
+    {
+        CacheSlot& slot = pSet[i % CACHE_WAYS];
+        if (slot.matches.get() == nullptr || !slot.used.exchange(false, std::memory_order_relaxed))
+        {
+            pVictim = &slot;
+            break;
+        }
     }
+    pVictim->used.store(true, std::memory_order_relaxed);
+    // The entry replaced is retired, posts still reading it are pinned.
+    pVictim->matches.store(matches);
+    return matches.get();
 }
 
-bool NotificationCenter::postNotification(NotificationCenter::notification_const_iterator& notification) const
+bool NotificationCenter::postTopic(const std::string& topic) const
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    if (notification != m_observers.end())
+    NotificationId id(topic);
+    bool bDelivered = deliver(id);
+
+    Epoch::Guard guard;
+    const topic_index* index = m_topics.get();
+    if (index->subscriptions.empty())
+    {
+        return bDelivered;
+    }
+
+    const TopicMatches* matches = index->find(topic, id.value());
+    if (matches == nullptr)
     {
-        const std::list<NotificationObserver>& notiList = notification->second;
-        for (auto& i : notiList)
+        matches = index->insert(topic, id.value());
+    }
+
+    std::shared_ptr<const void> owner;
+    for (auto i : matches->values)
+    {
+        const NotificationObserver& observer = index->subscriptions[i].observer;
+        if (observer.inbox && !owner)
         {
-            i.callback();
+            owner = index->shared_from_this();
         }
-        return true;
+        invoke(observer, owner);
     }
-    else
+    return bDelivered || !matches->values.empty();
+}
+
+bool NotificationCenter::postNotification(NotificationId name) const
+{
+    if (!deliver(name))
     {
-        printf("WARNING: Notification \"%s\" does not exist.\n", notification->first.data());
+        if (name.name() != nullptr)
+        {
+            printf("WARNING: Notification \"%s\" does not exist.\n", name.name());
+        }
+        else
+        {
+            printf("WARNING: Notification %016llx does not exist.\n", static_cast<unsigned long long>(name.value()));
+        }
         return false;
     }
+    return true;
 }
 
-NotificationCenter::notification_iterator NotificationCenter::getNotificationIterator(const std::string& notification)
+void NotificationCenter::postNotificationAsync(NotificationId name, bool coalesce, WorkQueue* queue)
 {
-    notification_iterator retVal;
-    if (m_observers.find(notification) != m_observers.end())
     {
-        retVal = m_observers.find(notification);
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        if (coalesce && !m_coalescing.insert(name.value()).second)
+        {
+            return;
+        }
+        ++m_asyncCount;
     }
-    
-    return retVal;
+
+    if (queue == nullptr)
+    {
+        queue = WorkQueue::getInstance();
+    }
+    queue->post([this, name, coalesce]{
+        // Clear the mark first, a post made while the observers run is delivered again.
+        if (coalesce)
+        {
+            std::lock_guard<std::mutex> lock(m_asyncMutex);
+            m_coalescing.erase(name.value());
+        }
+
+        deliver(name);
+
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        if (--m_asyncCount == 0)
+        {
+            m_asyncDone.notify_all();
+        }
+    });
+}
+
+NotificationCenter::DeferredBuffer* NotificationCenter::deferredBuffer()
+{
+    for (size_t i = 0; i < DEFERRED_CACHE_SIZE; ++i)
+    {
+        if (s_deferredCache[i].serial == m_serial)
+        {
+            return static_cast<DeferredBuffer*>(s_deferredCache[i].buffer);
+        }
+    }
+
+    // First post from this thread, or the cache moved on. A buffer left by
+    // an exited thread with the same id is taken over. Buffers are only ever
+    // pushed, the list is walked without a lock.
+    DeferredBuffer* pBuffer = nullptr;
+    std::thread::id self = std::this_thread::get_id();
+    DeferredBuffer* pHead = m_deferredBuffers.load();
+    for (DeferredBuffer* pNode = pHead; pNode != nullptr; pNode = pNode->next)
+    {
+        if (pNode->owner == self)
+        {
+            pBuffer = pNode;
+            break;
+        }
+    }
+    if (pBuffer == nullptr)
+    {
+        pBuffer = new DeferredBuffer;
+        pBuffer->owner = self;
+        do
+        {
+            pBuffer->next = pHead;
+        } while (!m_deferredBuffers.compare_exchange_weak(pHead, pBuffer));
+    }
+
+    DeferredCacheEntry& entry = s_deferredCache[s_deferredCacheNext++ % DEFERRED_CACHE_SIZE];
+    entry.serial = m_serial;
+    entry.buffer = pBuffer;
+    return pBuffer;
+}
+
+void NotificationCenter::postNotificationDeferred(NotificationId name)
+{
+    DeferredBuffer* pBuffer = deferredBuffer();
+    // Entering is sequentially consistent with the load of the half, as
+    // flush switches halves before it reads the sequence: either flush sees
+    // this post under way, or the post sees the switch.
+    unsigned sequence = pBuffer->sequence.load(std::memory_order_relaxed);
+    pBuffer->sequence.store(sequence + 1);
+    pBuffer->ids[pBuffer->active.load()].push_back(name);
+    pBuffer->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+size_t NotificationCenter::flush()
+{
+    std::vector<NotificationId> ids;
+    {
+        std::lock_guard<std::mutex> lock(m_deferredMutex);
+        for (DeferredBuffer* pBuffer = m_deferredBuffers.load(); pBuffer != nullptr; pBuffer = pBuffer->next)
+        {
+            unsigned retired = pBuffer->active.load(std::memory_order_relaxed);
+            pBuffer->active.store(retired ^ 1);
+
+            // A post under way may still append to the retired half, wait
+            // until it is done. Later posts go to the active half.
+            unsigned sequence = pBuffer->sequence.load();
+            if (sequence & 1)
+            {
+                while (pBuffer->sequence.load(std::memory_order_acquire) == sequence)
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            // The halves keep their capacity for the next frame.
+            std::vector<NotificationId>& half = pBuffer->ids[retired];
+            ids.insert(ids.end(), half.begin(), half.end());
+            half.clear();
+        }
+    }
+
+    std::sort(ids.begin(), ids.end(), [](NotificationId a, NotificationId b){ return a.value() < b.value(); });
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    size_t nDelivered = 0;
+    for (auto& id : ids)
+    {
+        if (deliver(id))
+        {
+            ++nDelivered;
+        }
+    }
+    return nDelivered;
 }
 
 std::shared_ptr<NotificationCenter> NotificationCenter::defaultCenter()
@@ -128,4 +697,4 @@ std::shared_ptr<NotificationCenter> NotificationCenter::defaultCenter()
     return m_defaultCenter;
 }
 
-} // namespace Foundation
\ No newline at end of file
+} // namespace Foundation
@@ -1,4 +1,3 @@
-
 /****************************************************************************
   Copyright (c) 2013-2014 libo.
  
@@ -9,74 +8,238 @@
 #ifndef Foundation_NotificationCenter_h
 #define Foundation_NotificationCenter_h
 
+#include <cstdint>
 #include <iostream>
-#include <unordered_map>
 #include <functional>
 #include <string>
-#include <list>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <memory>
+#include <atomic>
+#include <chrono>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include "Foundation/Epoch.h"
+#include "Foundation/Histogram.h"
+#include "NotificationId.h"
+#include "NotificationInbox.h"
+#include "NotificationTopic.h"
 
 namespace Foundation{
 
+class WorkQueue;
+
+typedef uint64_t ObserverHandle;
+
+static const ObserverHandle INVALID_OBSERVER = 0;
+
 struct NotificationObserver {
     std::function<void(void)> callback;
+    ObserverHandle            handle;
+    NotificationInbox::pointer inbox;   ///< null to call on the posting thread
+};
+
+/**
+ * An observer of the payload type T, see NotificationCenter::post.
+ */
+template<typename T>
+struct TypedObserver {
+    std::function<void(const T&)> callback;
+    ObserverHandle                handle;
+};
+
+/**
+ * A snapshot of the NotificationCenter metrics, see NotificationCenter::getMetrics.
+ * Times are in nanoseconds.
+ */
+struct NotificationMetrics
+{
+    struct Notification
+    {
+        uint64_t             id;           ///< NotificationId::value()
+        uint64_t             posts;
+        uint64_t             deliveries;   ///< observers called or queued, over all posts
+        uint64_t             maxFanOut;    ///< most observers reached by one post
+        Histogram::Snapshot  latency;      ///< of the callbacks run on the posting thread
+
+        Notification() : id(0), posts(0), deliveries(0), maxFanOut(0) {}
+    };
+
+    /**
+     * An observer that took longer than the budget at least once.
+     */
+    struct SlowObserver
+    {
+        ObserverHandle       handle;
+        uint64_t             id;
+        uint64_t             slowCalls;
+        uint64_t             worstTime;
+
+        SlowObserver() : handle(INVALID_OBSERVER), id(0), slowCalls(0), worstTime(0) {}
+    };
+
+    std::vector<Notification> notifications;
+    std::vector<SlowObserver> slowObservers;
+};
+
+namespace detail {
+
+/**
+ * The address of tag is the key of the channel of T, known without typeid.
+ * The tag is not const, so identical constants of different types can't
+ * be folded into one address by the linker.
+ */
+template<typename T>
+struct NotificationType
+{
+    static char tag;
+
+    static uint64_t key() { return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&tag)); }
 };
 
+template<typename T>
+char NotificationType<T>::tag = 0;
+
+} // namespace detail
+
+/**
+ * Observers are kept in immutable snapshots. A post pins its thread with
+ * an Epoch::Guard, loads the current snapshot and runs the callbacks
+ * without holding any lock or touching a reference count, so posts on many
+ * threads don't contend, a slow observer only delays its own post, and an
+ * observer may post or change the observers itself. Adding an observer
+ * appends it to the list of that notification in place, removing one only
+ * marks its entry, see observer_list; a list is copied only when it is
+ * compacted. A post walks the entries that were there when it started and
+ * skips the marked ones, so an observer removed while a post is under way
+ * may still be called once.
+ */
 class NotificationCenter
 {
-    static std::shared_ptr<NotificationCenter> m_defaultCenter;
-    std::unordered_map<std::string, std::list<NotificationObserver> > m_observers;
-    mutable std::mutex m_mutex;
 public:
-    
-    typedef std::unordered_map<std::string, std::list<NotificationObserver> >::const_iterator notification_const_iterator;
-    typedef std::unordered_map<std::string, std::list<NotificationObserver> >::iterator       notification_iterator;
-    typedef std::list<NotificationObserver>::const_iterator                                   observer_const_iterator;
-    typedef std::list<NotificationObserver>::iterator                                         observer_iterator;
-    
+    enum { COMPACT_THRESHOLD = 8 };
+
+    /**
+     * The observers of one notification, in a dense array a post walks
+     * front to back. The writer appends into the spare capacity and then
+     * publishes the new size, and removes an observer by marking its entry,
+     * so neither copies the list. A full list, a short one that lost an
+     * entry, or one that is mostly removed entries, is compacted into a
+     * new list that replaces it in the table.
+     */
+    class observer_list
+    {
+    public:
+        struct Entry
+        {
+            NotificationObserver                  observer;
+            std::atomic<bool>                     removed;
+
+            Entry() : removed(false) {}
+        };
+
+        explicit observer_list(size_t capacity);
+
+        size_t size() const { return m_size.load(std::memory_order_acquire); }
+
+        size_t capacity() const { return m_capacity; }
+
+        size_t removedCount() const { return m_removed; }
+
+        const Entry& operator[](size_t i) const { return m_entries[i]; }
+
+        /** Set by the first metered post, shared by the lists compacted from this one. */
+        mutable std::atomic<void*>                metrics;
+
+        /**
+         * @brief Append an observer, the list must not be full. Writer only.
+         */
+        void append(const NotificationObserver& observer);
+
+        /**
+         * @brief Mark the entry at a position removed. Writer only.
+         */
+        void remove(size_t position);
+
+    private:
+        std::unique_ptr<Entry[]>                  m_entries;
+        size_t                                    m_capacity;
+        std::atomic<size_t>                       m_size;
+        size_t                                    m_removed;   ///< writer only
+    };
+
+    /**
+     * An open-addressing table from a notification id or a payload type
+     * key to its observer list, probed linearly from the low bits of the
+     * key. It is never changed once published, a writer builds a new one.
+     */
+    struct observer_table : public std::enable_shared_from_this<observer_table>
+    {
+        struct Slot
+        {
+            uint64_t                              id;         ///< 0 for an empty slot
+            std::shared_ptr<void>                 observers;  ///< an observer_list or a typed list
+
+            Slot() : id(0) {}
+        };
+
+        std::vector<Slot>                         slots;  ///< a power of two, at most half full
+
+        void* find(uint64_t key) const;
+
+        /**
+         * @brief Build a copy with the list of a key replaced, removed if null.
+         */
+        std::shared_ptr<const observer_table> with(uint64_t key, std::shared_ptr<void> observers) const;
+    };
+
+    NotificationCenter();
+
+    /**
+     * Waits for the asynchronous posts still queued, so it must not run
+     * from inside one of their callbacks.
+     */
+    ~NotificationCenter();
+
+    // Names may be given as string literals, std::string or NotificationId,
+    // see NotificationId.
+
     /**
      * This method adds a function callback as an observer to a named method.
      * @param method the function callback.  Accepts void(void) methods or lambdas.
      * @param name the name of the notification you wish to observe.
+     * @return the handle of the observer, used to remove it.
      */
-    observer_const_iterator addObserver(std::function<void(void)> method, const std::string& name);
-    
+    ObserverHandle addObserver(std::function<void(void)> method, NotificationId name);
+
     /**
-     * This method adds a function callback as an observer to a given method.
+     * This method adds an observer that is called on the thread owning an inbox.
+     * Posts only queue the callback, the owner runs it from NotificationInbox::drain.
      * @param method the function callback.  Accepts void(void) methods or lambdas.
      * @param name the name of the notification you wish to observe.
+     * @param inbox the inbox of the thread the callback should run on.
+     * @return the handle of the observer, used to remove it.
      */
-    observer_const_iterator addObserver(std::function<void(void)> method, notification_iterator& notification);
+    ObserverHandle addObserver(std::function<void(void)> method, NotificationId name, NotificationInbox::pointer inbox);
     
     /**
-     * This method removes an observer by iterator.
+     * This method removes an observer by handle, in constant time. A handle that was
+     * already removed, or belongs to another notification, is ignored. The callback
+     * itself is released when its list is compacted, at once for a list of fewer than
+     * COMPACT_THRESHOLD observers, else once most of the list was removed.
      * @param name the name of the notification you wish to remove a given observer from.
-     * @param observer the iterator to the observer you wish to remove.
+     * @param observer the handle returned by addObserver.
      */
-    void removeObserver(const std::string& name, observer_const_iterator& observer);
-    
-    /**
-     * This method removes an observer by iterator.
-     * @param notification the iterator of the notification you wish to remove a given observer from.
-     * @param observer the iterator to the observer you wish to remove.
-     */
-    void removeObserver(notification_iterator& notification, observer_const_iterator& observer);
+    void removeObserver(NotificationId name, ObserverHandle observer);
     
     /**
      * This method removes all observers from a given notification, removing the notification 
      * from being tracked outright.
      * @param name the name of the notification you wish to remove.
      */
-    void removeObservers(const std::string& name);
-    
-    /**
-     * This method removes all observers from a given notification, removing the notification 
-     * from being tracked outright.
-     * @param notification the iterator of the notification you wish to remove.
-     */
-    void removeAllObservers(notification_iterator& notification);
+    void removeObservers(NotificationId name);
     
     /**
      * This method posts a notification to a set of observers.
@@ -85,32 +248,335 @@ public:
      * console and return false.
      * @param name the name of the notification you wish to post.
      */
-    bool postNotification(const std::string& name) const;
-    
+    bool postNotification(NotificationId name) const;
+
     /**
-     * This method posts a notification to a set of observers.
-     * If successful, this function calls all callbacks associated with that notification and 
-     * return true.  If no such notification exists, this function will print a warning to the 
-     * console and return false.
+     * This method queues a notification onto a WorkQueue and returns at once, the
+     * observers run on a pool thread with the snapshot taken at delivery time.
      * @param name the name of the notification you wish to post.
+     * @param coalesce if true, posts of the same name made before the queued one is
+     * delivered collapse into it.
+     * @param queue the queue to deliver on, the shared WorkQueue if null.
      */
-    bool postNotification(notification_const_iterator& notification) const;
-    
+    void postNotificationAsync(NotificationId name, bool coalesce = false, WorkQueue* queue = nullptr);
+
     /**
-     * This method retrieves a notification iterator for a named notification.
-     * The returned iterator may be used with the overloaded variants of postNotification, 
-     * removeAllObservers, removeObserver, and addObserver to avoid string lookups.
+     * This method queues a notification until the next flush. The poster only appends
+     * the id to a buffer of its own thread, no lock is taken. The first post of a
+     * thread to this center, or one after the thread posted deferred to several
+     * other centers, looks the buffer up in a list shared by the posting threads.
      * @param name the name of the notification you wish to post.
      */
-    notification_iterator getNotificationIterator(const std::string& notification);
+    void postNotificationDeferred(NotificationId name);
+
+    /**
+     * This method delivers the deferred notifications of all threads on the calling
+     * thread, ordered by id and each id once however often it was posted.
+     * @return the number of notifications delivered.
+     */
+    size_t flush();
     
+    /**
+     * This method adds an observer to every topic matching a pattern, see TopicTrie.
+     * @param method the function callback.  Accepts void(void) methods or lambdas.
+     * @param pattern a dotted topic, where "*" stands for one segment and "#" for
+     * any number of segments, e.g. "net.http.*" or "game.#".
+     * @param inbox the inbox of the thread the callback should run on, null for the
+     * posting thread.
+     * @return the handle of the observer, used to remove it.
+     */
+    ObserverHandle addTopicObserver(std::function<void(void)> method, const std::string& pattern,
+        NotificationInbox::pointer inbox = nullptr);
+
+    /**
+     * This method removes an observer added with addTopicObserver.
+     */
+    void removeTopicObserver(ObserverHandle observer);
+
+    /**
+     * This method posts a concrete topic. It runs the observers added for exactly
+     * that name, as postNotification does, and the topic observers whose pattern
+     * matches it. The matching topic observers of the recently posted topics
+     * are cached until the topic observers change, a post of a cached topic
+     * takes no lock.
+     * @param topic a dotted topic without wildcards.
+     * @return false if no observer was found.
+     */
+    bool postTopic(const std::string& topic) const;
+
+    /**
+     * This method adds an observer to the payloads of type T.
+     * @param method the function callback, called with the posted payload.
+     * @return the handle of the observer, used to remove it.
+     */
+    template<typename T>
+    ObserverHandle addObserver(std::function<void(const T&)> method)
+    {
+        typedef std::vector<TypedObserver<T> > typed_list;
+
+        TypedObserver<T> n;
+        n.callback = std::move(method);
+        n.handle = m_nextHandle++;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const observer_table* current = m_channels.get();
+        std::shared_ptr<typed_list> observers = std::make_shared<typed_list>();
+        const typed_list* pOld = static_cast<const typed_list*>(current->find(detail::NotificationType<T>::key()));
+        if (pOld != nullptr)
+        {
+            observers->reserve(pOld->size() + 1);
+            observers->insert(observers->end(), pOld->begin(), pOld->end());
+        }
+        observers->push_back(std::move(n));
+        m_channels.store(current->with(detail::NotificationType<T>::key(), observers));
+        return observers->back().handle;
+    }
+
+    /**
+     * This method removes an observer of the payloads of type T.
+     * @param observer the handle returned by addObserver<T>.
+     */
+    template<typename T>
+    void removeObserver(ObserverHandle observer)
+    {
+        typedef std::vector<TypedObserver<T> > typed_list;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const observer_table* current = m_channels.get();
+        const typed_list* pOld = static_cast<const typed_list*>(current->find(detail::NotificationType<T>::key()));
+        if (pOld == nullptr)
+        {
+            return;
+        }
+
+        std::shared_ptr<typed_list> observers = std::make_shared<typed_list>();
+        for (auto& o : *pOld)
+        {
+            if (o.handle != observer)
+            {
+                observers->push_back(o);
+            }
+        }
+        if (observers->size() != pOld->size())
+        {
+            m_channels.store(current->with(detail::NotificationType<T>::key(),
+                observers->empty() ? std::shared_ptr<void>() : observers));
+        }
+    }
+
+    /**
+     * This method posts a payload to the observers of its type. The payload is
+     * passed by reference, nothing is copied or allocated.
+     * @return false if the type has no observers.
+     */
+    template<typename T>
+    bool post(const T& payload) const
+    {
+        typedef std::vector<TypedObserver<T> > typed_list;
+
+        Epoch::Guard guard;
+        const observer_table* table = m_channels.get();
+        const typed_list* observers = static_cast<const typed_list*>(table->find(detail::NotificationType<T>::key()));
+        if (observers == nullptr)
+        {
+            return false;
+        }
+        for (auto& o : *observers)
+        {
+            o.callback(payload);
+        }
+        return true;
+    }
+
     /**
      * This method returns the default global notification center.  You may alternatively 
      * create your own notification center without using the default notification center.
      */
     static std::shared_ptr<NotificationCenter> defaultCenter();
+
+    /**
+     * This method turns the delivery metrics on or off, they are off by default.
+     * Metered posts count their observers and time each callback run on the
+     * posting thread; typed and topic observers are not metered.
+     */
+    void setMetricsEnabled(bool enabled);
+
+    /**
+     * This method sets how long a callback may run before its observer is
+     * reported in NotificationMetrics::slowObservers.
+     */
+    void setSlowObserverBudget(std::chrono::microseconds budget);
+
+    /**
+     * This method takes a snapshot of the metrics collected so far.
+     */
+    NotificationMetrics getMetrics() const;
+
+private:
+    void publish(std::shared_ptr<const observer_table> table);
+
+    /**
+     * @brief Run the observers of a notification.
+     * @return false if it has none.
+     */
+    bool deliver(NotificationId name) const;
+
+    /**
+     * @brief Call an observer, or queue it to its inbox.
+     * @param owner keeps the observer alive while it waits in the inbox,
+     *        only needed for an inbox observer.
+     */
+    static void invoke(const NotificationObserver& observer, const std::shared_ptr<const void>& owner);
+
+    struct TopicSubscription
+    {
+        std::string                            pattern;
+        NotificationObserver                   observer;
+    };
+
+    /**
+     * The subscriptions matching one topic.
+     */
+    struct TopicMatches
+    {
+        std::string                            topic;
+        std::vector<size_t>                    values;
+    };
+
+    /**
+     * The topic observers and their trie, rebuilt on every change. The
+     * cache of matches lives and dies with it.
+     *
+     * The cache is a set associative table of published entries, read by
+     * posts under an Epoch::Guard without a lock. A miss matches the topic
+     * and publishes it under cacheMutex, in place of an entry of its set
+     * not used since the set last evicted, so a busy topic stays cached
+     * however many others come and go.
+     */
+    struct topic_index : public std::enable_shared_from_this<topic_index>
+    {
+        enum { CACHE_SETS = 1024, CACHE_WAYS = 4 };
+
+        struct CacheSlot
+        {
+            EpochPtr<const TopicMatches>       matches;
+            std::atomic<bool>                  used;
+
+            CacheSlot() : matches(std::shared_ptr<const TopicMatches>()), used(false) {}
+        };
+
+        topic_index() : cache(new CacheSlot[CACHE_SETS * CACHE_WAYS]) {}
+
+        /**
+         * @brief Get the cached matches of a topic, or nullptr.
+         */
+        const TopicMatches* find(const std::string& topic, uint64_t nHash) const;
+
+        /**
+         * @brief Match a topic and cache it.
+         */
+        const TopicMatches* insert(const std::string& topic, uint64_t nHash) const;
+
+        std::vector<TopicSubscription>         subscriptions;
+        TopicTrie                              trie;
+        mutable std::mutex                     cacheMutex;    ///< serializes the cache writers
+        std::unique_ptr<CacheSlot[]>           cache;
+    };
+
+    void publishTopics(std::vector<TopicSubscription> subscriptions);
+
+    /**
+     * The counters of one notification, alive as long as the center.
+     */
+    struct DeliveryMetrics
+    {
+        uint64_t                               id;
+        std::atomic<uint64_t>                  posts;
+        std::atomic<uint64_t>                  deliveries;
+        std::atomic<uint64_t>                  maxFanOut;
+        Histogram                              latency;
+
+        explicit DeliveryMetrics(uint64_t nId) : id(nId), posts(0), deliveries(0), maxFanOut(0) {}
+    };
+
+    /**
+     * @brief Get the metrics of the notification of a list, created on first use.
+     */
+    DeliveryMetrics* metricsOf(const observer_list& observers, NotificationId name) const;
+
+    void reportSlow(const NotificationObserver& observer, NotificationId name, uint64_t nTime) const;
+
+    /**
+     * @brief Copy the live observers of a list into a new one with room
+     *        to grow, and point their handle slots at the new positions.
+     */
+    std::shared_ptr<observer_list> compact(const observer_list* pOld, size_t nExtra);
+
+    /**
+     * Where the observer behind a handle lives. A handle is the slot index
+     * and the generation of the slot, so a stale handle no longer matches
+     * once the slot is reused.
+     */
+    struct HandleSlot
+    {
+        uint32_t                               generation;
+        uint64_t                               id;         ///< 0 while the slot is free
+        size_t                                 position;   ///< in the observer_list of id
+
+        HandleSlot() : generation(1), id(0), position(0) {}
+    };
+
+    HandleSlot* slotOf(ObserverHandle handle);
+
+    void releaseSlot(ObserverHandle handle);
+
+    /**
+     * The deferred ids of one thread, in two halves. The thread appends to
+     * the active half without a lock; flush makes the other half active and
+     * takes the ids of the retired one once the thread has left it.
+     */
+    struct DeferredBuffer
+    {
+        std::vector<NotificationId>            ids[2];
+        std::atomic<unsigned>                  active;    ///< the half appended to
+        std::atomic<unsigned>                  sequence;  ///< odd while the owner appends
+        std::thread::id                        owner;
+        DeferredBuffer*                        next;
+
+        DeferredBuffer() : active(0), sequence(0), next(nullptr) {}
+    };
+
+    /**
+     * @brief Get the deferred buffer of the calling thread.
+     */
+    DeferredBuffer* deferredBuffer();
+
+    static std::shared_ptr<NotificationCenter> m_defaultCenter;
+
+    EpochPtr<const observer_table>             m_observers;   ///< read by posts under an Epoch::Guard
+    EpochPtr<const observer_table>             m_channels;    ///< typed observers by payload type
+    EpochPtr<const topic_index>                m_topics;      ///< read by posts under an Epoch::Guard
+    std::atomic<ObserverHandle>                m_nextHandle;  ///< handles of typed observers
+    std::mutex                                 m_mutex;       ///< serializes the writers
+    std::vector<HandleSlot>                    m_handleSlots; ///< guarded by m_mutex
+    std::vector<uint32_t>                      m_freeSlots;   ///< guarded by m_mutex
+
+    std::unordered_set<uint64_t>               m_coalescing;  ///< ids with a coalesced post queued
+    std::mutex                                 m_asyncMutex;  ///< guards m_coalescing and m_asyncCount
+    std::condition_variable                    m_asyncDone;
+    size_t                                     m_asyncCount;  ///< async posts queued or running
+
+    const uint64_t                             m_serial;      ///< tells centers apart in the thread caches
+    std::atomic<DeferredBuffer*>               m_deferredBuffers;  ///< pushed by posters, never removed
+    std::mutex                                 m_deferredMutex;    ///< serializes flush
+
+    std::atomic<bool>                          m_metricsEnabled;
+    std::atomic<uint64_t>                      m_slowBudget;  ///< nanoseconds
+    mutable std::unordered_map<uint64_t, std::unique_ptr<DeliveryMetrics> > m_metrics;  ///< guarded by m_metricsMutex
+    mutable std::unordered_map<ObserverHandle, NotificationMetrics::SlowObserver> m_slowObservers;  ///< guarded by m_metricsMutex
+    mutable std::mutex                         m_metricsMutex;
 };
 
 } // namespace Foundation
 
-#endif // Foundation_NotificationCenter_h
\ No newline at end of file
+#endif // Foundation_NotificationCenter_h
@@ -0,0 +1,86 @@
+/****************************************************************************
+  Copyright (c) 2013-2014 libo.
+ 
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_NotificationId_h
+#define Foundation_NotificationId_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Foundation{
+
+namespace detail {
+
+/**
+ * 64 bit FNV-1a, recursive so it stays a C++11 constexpr function.
+ */
+constexpr uint64_t fnv1a(const char* s, uint64_t hash = 14695981039346656037ULL)
+{
+    return *s == 0 ? hash : fnv1a(s + 1, (hash ^ static_cast<uint8_t>(*s)) * 1099511628211ULL);
+}
+
+inline uint64_t fnv1aRange(const char* s, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ static_cast<uint8_t>(s[i])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+} // namespace detail
+
+/**
+ * The interned name of a notification: the 64 bit hash of the name.
+ *
+ * A string literal hashes at compile time when the id is a constant,
+ * a std::string hashes at run time without allocating:
+ *
+ *     static constexpr NotificationId PLAYER_DIED("player.died");
+ *     center->postNotification(PLAYER_DIED);
+ *     center->postNotification(std::string("player.died"));   // same id
+ *
+ * Two names are assumed never to hash alike.
+ */
+class NotificationId
+{
+public:
+    constexpr NotificationId() : m_value(0), m_name(nullptr) {}
+
+    constexpr NotificationId(const char* name) : m_value(nonZero(detail::fnv1a(name))), m_name(name) {}
+
+    NotificationId(const std::string& name) : m_value(nonZero(detail::fnv1aRange(name.data(), name.size()))), m_name(nullptr) {}
+
+    /**
+     * @brief The hash, never 0 for a named id.
+     */
+    constexpr uint64_t value() const { return m_value; }
+
+    /**
+     * @brief The name an id was made from as a const char*, for diagnostics,
+     *        else nullptr. Not copied: only valid as long as that string,
+     *        which for a literal is forever.
+     */
+    constexpr const char* name() const { return m_name; }
+
+    constexpr bool operator==(const NotificationId& other) const { return m_value == other.m_value; }
+
+    constexpr bool operator!=(const NotificationId& other) const { return m_value != other.m_value; }
+
+private:
+    // 0 marks an empty slot of the observer table.
+    static constexpr uint64_t nonZero(uint64_t hash) { return hash != 0 ? hash : 1; }
+
+    uint64_t    m_value;
+    const char* m_name;
+};
+
+} // namespace Foundation
+
+#endif // Foundation_NotificationId_h
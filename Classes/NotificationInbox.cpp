@@ -0,0 +1,83 @@
+/****************************************************************************
+  Copyright (c) 2013-2014 libo.
+ 
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include <algorithm>
+#include <iterator>
+#include "NotificationInbox.h"
+namespace Foundation{
+
+NotificationInbox::NotificationInbox(std::function<void(void)> wake, size_t capacity)
+    : m_queue(capacity)
+    , m_overflowing(false)
+    , m_count(0)
+    , m_wake(wake)
+{
+}
+
+void NotificationInbox::push(item_type item)
+{
+    // Once a callback overflowed, the later ones follow it to keep the order.
+    if (m_overflowing || !m_queue.tryPush(std::move(item)))
+    {
+        std::lock_guard<std::mutex> lock(m_overflowMutex);
+        m_overflow.push_back(std::move(item));
+        m_overflowing = true;
+    }
+
+    if (m_count++ == 0 && m_wake)
+    {
+        m_wake();
+    }
+}
+
+size_t NotificationInbox::drain()
+{
+    size_t nTotal = 0;
+    while (true)
+    {
+        size_t nCount = 0;
+        item_type item;
+        while (m_queue.tryPop(item))
+        {
+            (*item)();
+            item.reset();
+            ++nCount;
+        }
+
+        if (m_overflowing)
+        {
+            // The ring may have filled up again since the loop above, and
+            // the overflow is newer than all of it. Empty the ring first.
+            std::deque<item_type> batch;
+            {
+                std::lock_guard<std::mutex> lock(m_overflowMutex);
+                while (m_queue.tryPop(item))
+                {
+                    batch.push_back(std::move(item));
+                }
+                std::move(m_overflow.begin(), m_overflow.end(), std::back_inserter(batch));
+                m_overflow.clear();
+                m_overflowing = false;
+            }
+            for (auto& i : batch)
+            {
+                (*i)();
+                ++nCount;
+            }
+        }
+
+        // A push counts itself after it is queued, so a count left over
+        // means callbacks arrived while these ran, and nobody woke us for them.
+        nTotal += nCount;
+        if (nCount == 0 || m_count.fetch_sub(nCount) == nCount)
+        {
+            return nTotal;
+        }
+    }
+}
+
+} // namespace Foundation
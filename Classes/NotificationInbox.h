@@ -0,0 +1,77 @@
+/****************************************************************************
+  Copyright (c) 2013-2014 libo.
+ 
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_NotificationInbox_h
+#define Foundation_NotificationInbox_h
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "Foundation/RingQueue.h"
+
+namespace Foundation{
+
+/**
+ * The notifications of the observers bound to one thread.
+ *
+ * An observer added with an inbox is not called by the posting thread.
+ * The post pushes the callback into the inbox, a lock-free MPSC ring, and
+ * the owning thread runs it when it calls drain(), so the observer's data
+ * is only ever touched by its own thread and needs no lock. When the
+ * ring is full the callbacks go to an overflow list behind a mutex, in
+ * order, until the next drain.
+ *
+ *     auto inbox = std::make_shared<NotificationInbox>([&io]{ io.post([&]{ inbox->drain(); }); });
+ *     center->addObserver([this]{ onLogin(); }, "user.login", inbox);
+ */
+class NotificationInbox
+{
+public:
+    typedef std::shared_ptr<NotificationInbox> pointer;
+
+    /**
+     * @param wake called by the posting thread when the inbox turns non-empty,
+     * typically to schedule a drain on the owning thread. May be empty.
+     * @param capacity the size of the ring, rounded up to a power of two.
+     */
+    explicit NotificationInbox(std::function<void(void)> wake = std::function<void(void)>(), size_t capacity = 1024);
+
+    /**
+     * This method runs the queued callbacks in posting order. Only the owning thread
+     * may call it.
+     * @return the number of callbacks run.
+     */
+    size_t drain();
+
+    /**
+     * This method returns the number of callbacks waiting to run.
+     */
+    size_t size() const { return m_count.load(std::memory_order_relaxed); }
+
+private:
+    friend class NotificationCenter;
+
+    /**
+     * The callback lives in an observer snapshot, which the pointer keeps alive.
+     */
+    typedef std::shared_ptr<const std::function<void(void)> > item_type;
+
+    void push(item_type item);
+
+    RingQueue<item_type, RingQueueMode::MPSC>  m_queue;
+    std::deque<item_type>                      m_overflow;     ///< guarded by m_overflowMutex
+    std::mutex                                 m_overflowMutex;
+    std::atomic<bool>                          m_overflowing;  ///< producers skip the ring while set
+    std::atomic<size_t>                        m_count;
+    std::function<void(void)>                  m_wake;
+};
+
+} // namespace Foundation
+
+#endif // Foundation_NotificationInbox_h
@@ -0,0 +1,100 @@
+/****************************************************************************
+  Copyright (c) 2013-2014 libo.
+ 
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include <algorithm>
+#include "NotificationTopic.h"
+namespace Foundation{
+
+TopicTrie::TopicTrie()
+    : m_root(new Node)
+{
+}
+
+std::vector<std::string> TopicTrie::split(const std::string& topic)
+{
+    std::vector<std::string> segments;
+    size_t nStart = 0;
+    while (true)
+    {
+        size_t nDot = topic.find('.', nStart);
+        segments.push_back(topic.substr(nStart, nDot - nStart));
+        if (nDot == std::string::npos)
+        {
+            break;
+        }
+        nStart = nDot + 1;
+    }
+    return segments;
+}
+
+void TopicTrie::insert(const std::string& pattern, size_t value)
+{
+    Node* pNode = m_root.get();
+    std::vector<std::string> segments = split(pattern);
+    for (auto& segment : segments)
+    {
+        std::unique_ptr<Node>* ppNext = nullptr;
+        if (segment == "*")
+        {
+            ppNext = &pNode->anyOne;
+        }
+        else if (segment == "#")
+        {
+            ppNext = &pNode->anyMany;
+        }
+        else
+        {
+            ppNext = &pNode->children[segment];
+        }
+        if (!*ppNext)
+        {
+            ppNext->reset(new Node);
+        }
+        pNode = ppNext->get();
+    }
+    pNode->values.push_back(value);
+}
+
+std::vector<size_t> TopicTrie::match(const std::string& topic) const
+{
+    std::vector<size_t> values;
+    match(m_root.get(), split(topic), 0, values);
+    // A pattern with several "#" can match one topic in more than one way.
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+}
+
+void TopicTrie::match(const Node* pNode, const std::vector<std::string>& segments, size_t nIndex, std::vector<size_t>& values)
+{
+    if (pNode->anyMany)
+    {
+        // "#" takes none, one or all of the remaining segments.
+        for (size_t i = nIndex; i <= segments.size(); ++i)
+        {
+            match(pNode->anyMany.get(), segments, i, values);
+        }
+    }
+
+    if (nIndex == segments.size())
+    {
+        values.insert(values.end(), pNode->values.begin(), pNode->values.end());
+        return;
+    }
+
+    auto child = pNode->children.find(segments[nIndex]);
+    if (child != pNode->children.end())
+    {
+        match(child->second.get(), segments, nIndex + 1, values);
+    }
+    if (pNode->anyOne)
+    {
+        match(pNode->anyOne.get(), segments, nIndex + 1, values);
+    }
+}
+
+} // namespace Foundation
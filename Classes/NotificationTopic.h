@@ -0,0 +1,65 @@
+/****************************************************************************
+  Copyright (c) 2013-2014 libo.
+ 
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#ifndef Foundation_NotificationTopic_h
+#define Foundation_NotificationTopic_h
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Foundation{
+
+/**
+ * A trie of dotted topic patterns.
+ *
+ * A pattern is a list of segments separated by '.'. The segment "*"
+ * matches exactly one segment of a topic and "#" matches zero or more,
+ * so "net.http.*" matches "net.http.get" and "game.#" matches "game",
+ * "game.start" and "game.level.end". Every pattern carries a value, match
+ * returns the values of all patterns matching a topic.
+ */
+class TopicTrie
+{
+public:
+    TopicTrie();
+
+    /**
+     * @brief Add a pattern with its value.
+     */
+    void insert(const std::string& pattern, size_t value);
+
+    /**
+     * @brief Get the values of the patterns matching a topic, sorted and
+     *        each once.
+     */
+    std::vector<size_t> match(const std::string& topic) const;
+
+    /**
+     * @brief Split a topic or a pattern at its dots.
+     */
+    static std::vector<std::string> split(const std::string& topic);
+
+private:
+    struct Node
+    {
+        std::unordered_map<std::string, std::unique_ptr<Node> > children;
+        std::unique_ptr<Node>                                    anyOne;    ///< "*"
+        std::unique_ptr<Node>                                    anyMany;   ///< "#"
+        std::vector<size_t>                                      values;
+    };
+
+    static void match(const Node* pNode, const std::vector<std::string>& segments, size_t nIndex, std::vector<size_t>& values);
+
+    std::unique_ptr<Node> m_root;
+};
+
+} // namespace Foundation
+
+#endif // Foundation_NotificationTopic_h